@@ -2,9 +2,29 @@
 // - Supports: null, bool, number (double), string (UTF-8), array, object
 // - Build: just include; no libs. For Windows/WinHTTP agents, perfect for small payloads.
 // Notes:
-// - Numbers parsed/stored as double. If you need int64, extend as needed.
+// - Numbers parsed/stored as double. ParseOptions::lazy_numbers keeps the source text instead,
+//   converting on access (as_int() is then exact for any int64) and re-emitting it verbatim.
 // - String escape handling covers \" \\ \/ \b \f \n \r \t. \uXXXX is preserved as literal backslash-u sequence.
 // - Pretty printing optional via dump(indent=2). Use dump() for compact.
+// - Copying a Json is O(1): arrays and objects are shared, and a copy detaches on the first
+//   non-const as_array/as_object/operator[]/push_back. A container that has handed out such a
+//   mutable reference is copied node by node from then on (its untouched children still shared),
+//   since the reference may yet be written through. A const reference taken before copying keeps
+//   reading the shared version after the original is written to.
+// - find/set_in/erase_in take JSON Pointers. set_in/erase_in return a new version and leave the
+//   original alone, so old versions can be kept and read from other threads without locks.
+// - JsonWriter streams the same output as dump() into a sink without building a tree.
+// - Json::raw(text) embeds pre-serialized JSON that dump() copies verbatim; ParseOptions::raw
+//   captures chosen subtrees that way instead of building them.
+// - parse() reads from a zero-padded copy of its input; pass a Json::PaddedString to skip the copy.
+// - String scanning/escaping uses SSE2, AVX2, AVX-512 or NEON, picked at runtime; see Json::use_simd.
+// - to_cbor()/from_cbor() and to_msgpack()/from_msgpack() convert to and from CBOR (RFC 8949)
+//   and MessagePack; Json::MsgPackView reads MessagePack in place.
+// - freeze() writes a binary image that Json::FrozenView reads in place (e.g. from a mmap'd file).
+// - Json::SharedSnapshot publishes frozen images in POSIX shared memory for other processes.
+// - Json::ArrayStream reads a huge array one element at a time from a stream, and
+//   Json::DocumentStream reads concatenated or RFC 7464 record-separated documents.
+// - ParseOptions::threads parses very large documents on several cores, with the same result.
 
 #pragma once
 #include <string>
@@ -12,18 +32,152 @@
 #include <variant>
 #include <vector>
 #include <map>
-#include <cctype>
 #include <stdexcept>
 #include <sstream>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <cstdint>
+#include <cassert>
+#include <type_traits>
+#include <memory>
+#include <optional>
+#include <atomic>
+#include <unordered_map>
+#include <functional>
+#include <istream>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#define MINIJSON_HAS_IOVEC 1
+#define MINIJSON_HAS_MMAP 1
+#else
+#define MINIJSON_HAS_IOVEC 0
+#define MINIJSON_HAS_MMAP 0
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MINIJSON_SSE2 1
+#else
+#define MINIJSON_SSE2 0
+#endif
+// AVX2/AVX-512 kernels are compiled in on x86-64 regardless of -m flags and only run if cpuid
+// reports support. Define MINIJSON_AVX 0 to leave them out.
+#ifndef MINIJSON_AVX
+#if defined(__x86_64__) || defined(_M_X64)
+#define MINIJSON_AVX 1
+#else
+#define MINIJSON_AVX 0
+#endif
+#endif
+#if MINIJSON_AVX
+#include <immintrin.h>
+#endif
+#if defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define MINIJSON_NEON 1
+#else
+#define MINIJSON_NEON 0
+#endif
+// ParseOptions::threads. Define MINIJSON_THREADS 0 to build without <thread>; parse() then
+// always runs on the calling thread.
+#ifndef MINIJSON_THREADS
+#define MINIJSON_THREADS 1
+#endif
+#if MINIJSON_THREADS
+#include <thread>
+#endif
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define MINIJSON_TARGET(isa)
+#else
+#define MINIJSON_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+template <class Sink = std::string> class JsonWriter;
 
 class Json {
+    template <class Sink> friend class JsonWriter;
 public:
     using Array = std::vector<Json>;
     using Object = std::map<std::string, Json>;
 
     // Types
     struct Null {};
-    using Value = std::variant<Null, bool, double, std::string, Array, Object>;
+    // Already-serialized JSON text, emitted verbatim by dump() (not re-indented).
+    struct Raw { std::string text; };
+    // Number kept as its source text until read (ParseOptions::lazy_numbers); dump() re-emits it as is.
+    // The non-const as_num() hands out num, parsed on first use; the text stands until num is changed.
+    struct NumberText {
+        std::string text;
+        double num{ 0 };
+        bool parsed{ false };
+    };
+
+    // Serialized form of a container, kept only on nodes that opted in with cache_dump().
+    struct DumpCache {
+        std::string text;
+        int indent{ 0 };
+        int depth{ 0 };
+        bool valid{ false };
+        bool fresh(int ind, int d) const { return valid && indent == ind && (ind < 0 || depth == d); }
+    };
+
+    // Ref-counted container node, shared by copies. mut() detaches before writing and drops the
+    // node's dump cache. expose() is mut() for a reference handed to the caller, who may write
+    // through it at any time: an exposed node is never shared again, copies copy it instead, and
+    // its dump cache is no longer used.
+    // A null node (default-constructed or moved from) is an empty container.
+    template <class T>
+    class Shared {
+        struct Node {
+            T data;
+            std::unique_ptr<DumpCache> cache;
+            bool exposed{ false };
+            Node() = default;
+            explicit Node(T t) : data(std::move(t)) {}
+            // The copy keeps caching on but starts empty.
+            Node(const Node& o) : data(o.data), cache(o.cache ? std::make_unique<DumpCache>() : nullptr) {}
+        };
+    public:
+        Shared() = default;
+        Shared(T t) : p_(std::make_shared<Node>(std::move(t))) {}
+        Shared(const Shared& o) : p_(o.p_ && o.p_->exposed ? std::make_shared<Node>(*o.p_) : o.p_) {}
+        Shared& operator=(const Shared& o) { if (this != &o) p_ = Shared(o).p_; return *this; }
+        Shared(Shared&&) noexcept = default;
+        Shared& operator=(Shared&&) noexcept = default;
+
+        const T& get() const {
+            static const T empty;
+            return p_ ? p_->data : empty;
+        }
+        T& mut() {
+            // use_count() is a relaxed load; the fence orders our writes after another thread's
+            // release of its last reference, so a sole owner can write in place.
+            if (!p_) p_ = std::make_shared<Node>();
+            else if (p_.use_count() > 1) p_ = std::make_shared<Node>(*p_);
+            else std::atomic_thread_fence(std::memory_order_acquire);
+            if (p_->cache) p_->cache->valid = false;
+            return p_->data;
+        }
+        T& expose() {
+            T& t = mut();
+            p_->exposed = true;
+            return t;
+        }
+        bool shares(const Shared& o) const { return p_ && p_ == o.p_; }
+        DumpCache* cache() const { return p_ && !p_->exposed ? p_->cache.get() : nullptr; }
+        void set_cache(bool on) { mut(); p_->cache = on ? std::make_unique<DumpCache>() : nullptr; }
+    private:
+        std::shared_ptr<Node> p_;
+    };
+
+    using Value = std::variant<Null, bool, double, std::string, Shared<Array>, Shared<Object>, Raw, NumberText>;
 
     // ctors
     Json() : v_(Null{}) {}
@@ -33,206 +187,1876 @@ public:
     Json(int i) : v_(static_cast<double>(i)) {}
     Json(const char* s) : v_(std::string(s)) {}
     Json(std::string s) : v_(std::move(s)) {}
-    Json(Array a) : v_(std::move(a)) {}
-    Json(Object o) : v_(std::move(o)) {}
+    Json(Array a) : v_(Shared<Array>(std::move(a))) {}
+    Json(Object o) : v_(Shared<Object>(std::move(o))) {}
+    Json(Raw r) : v_(std::move(r)) {}
+    Json(NumberText n) : v_(std::move(n)) {}
 
     // Static helpers
     static Json array() { return Json(Array{}); }
     static Json object() { return Json(Object{}); }
+    // Embeds a pre-serialized fragment; the caller vouches that text is valid JSON.
+    static Json raw(std::string text) { return Json(Raw{ std::move(text) }); }
+
+    // Memoizes this container's serialized text (and its container children's, down to `levels`
+    // more levels) so dump() splices unchanged subtrees in from cache. Any non-const accessor on
+    // the path from the root drops the caches along it, so after `j["a"]["b"] = 1` only the root
+    // and "a" are re-serialized. Those two handed out mutable references, which may be held and
+    // written through later, so they stay uncached from then on; read through a const Json& to
+    // keep a node cached (a copy starts clean). Cached nodes must not be dumped from two threads
+    // at once.
+    void cache_dump(bool on = true, int levels = 1) {
+        if (is_array()) {
+            std::get<Shared<Array>>(v_).set_cache(on);
+            if (levels > 0) for (auto& v : array_mut()) v.cache_dump(on, levels - 1);
+        }
+        else if (is_object()) {
+            std::get<Shared<Object>>(v_).set_cache(on);
+            if (levels > 0) for (auto& kv : object_mut()) kv.second.cache_dump(on, levels - 1);
+        }
+    }
+
+    // True if both values are containers backed by the same (not yet detached) node.
+    bool shares_with(const Json& o) const {
+        if (is_array() && o.is_array()) return std::get<Shared<Array>>(v_).shares(std::get<Shared<Array>>(o.v_));
+        if (is_object() && o.is_object()) return std::get<Shared<Object>>(v_).shares(std::get<Shared<Object>>(o.v_));
+        return false;
+    }
 
     // Type checks
     bool is_null()   const { return std::holds_alternative<Null>(v_); }
     bool is_bool()   const { return std::holds_alternative<bool>(v_); }
-    bool is_num()    const { return std::holds_alternative<double>(v_); }
+    bool is_num()    const { return std::holds_alternative<double>(v_) || std::holds_alternative<NumberText>(v_); }
     bool is_str()    const { return std::holds_alternative<std::string>(v_); }
-    bool is_array()  const { return std::holds_alternative<Array>(v_); }
-    bool is_object() const { return std::holds_alternative<Object>(v_); }
+    bool is_array()  const { return std::holds_alternative<Shared<Array>>(v_); }
+    bool is_object() const { return std::holds_alternative<Shared<Object>>(v_); }
+    bool is_raw()    const { return std::holds_alternative<Raw>(v_); }
 
     // Accessors (throws on wrong type)
     bool& as_bool() { return std::get<bool>(v_); }
-    double& as_num() { return std::get<double>(v_); }
+    double& as_num() {
+        if (auto* t = std::get_if<NumberText>(&v_)) {
+            if (!t->parsed) { t->num = to_double(t->text); t->parsed = true; }
+            return t->num;
+        }
+        return std::get<double>(v_);
+    }
     std::string& as_str() { return std::get<std::string>(v_); }
-    Array& as_array() { return std::get<Array>(v_); }
-    Object& as_object() { return std::get<Object>(v_); }
+    Array& as_array() { return std::get<Shared<Array>>(v_).expose(); }
+    Object& as_object() { return std::get<Shared<Object>>(v_).expose(); }
 
     const bool& as_bool()   const { return std::get<bool>(v_); }
-    const double& as_num()    const { return std::get<double>(v_); }
+    double as_num()           const {
+        if (auto* t = std::get_if<NumberText>(&v_)) return t->parsed ? t->num : to_double(t->text);
+        return std::get<double>(v_);
+    }
+    // Integer view of a number, truncating any fraction. Integer source text is converted
+    // exactly, so values beyond 2^53 survive when parsed with lazy_numbers. Throws if the value
+    // doesn't fit in an int64.
+    int64_t as_int() const {
+        if (auto* t = number_text()) {
+            int64_t v = 0;
+            auto r = std::from_chars(t->text.data(), t->text.data() + t->text.size(), v);
+            if (r.ec == std::errc() && r.ptr == t->text.data() + t->text.size()) return v;
+        }
+        return to_int64(as_num(), "JSON");
+    }
     const std::string& as_str()    const { return std::get<std::string>(v_); }
-    const Array& as_array()  const { return std::get<Array>(v_); }
-    const Object& as_object() const { return std::get<Object>(v_); }
+    const Array& as_array()  const { return std::get<Shared<Array>>(v_).get(); }
+    const Object& as_object() const { return std::get<Shared<Object>>(v_).get(); }
+    const std::string& as_raw() const { return std::get<Raw>(v_).text; }
 
     // Object conveniences
     Json& operator[](const std::string& key) {
-        if (!is_object()) v_ = Object{};
-        return std::get<Object>(v_)[key];
+        if (!is_object()) v_ = Shared<Object>{};
+        return as_object()[key];
     }
-    const Json& at(const std::string& key) const { return std::get<Object>(v_).at(key); }
+    const Json& at(const std::string& key) const { return as_object().at(key); }
     bool contains(const std::string& key) const {
         if (!is_object()) return false;
-        return std::get<Object>(v_).count(key) != 0;
+        return as_object().count(key) != 0;
     }
 
     // Array conveniences
     void push_back(const Json& j) {
-        if (!is_array()) v_ = Array{};
-        std::get<Array>(v_).push_back(j);
+        if (!is_array()) v_ = Shared<Array>{};
+        array_mut().push_back(j);
+    }
+
+    // JSON Pointer (RFC 6901) lookup; nullptr if the path doesn't exist.
+    const Json* find(std::string_view pointer) const {
+        const Json* cur = this;
+        std::string tok;
+        while (next_token(pointer, tok)) {
+            if (cur->is_object()) {
+                auto it = cur->as_object().find(tok);
+                if (it == cur->as_object().end()) return nullptr;
+                cur = &it->second;
+            }
+            else if (cur->is_array()) {
+                size_t idx;
+                if (!parse_index(tok, idx) || idx >= cur->as_array().size()) return nullptr;
+                cur = &cur->as_array()[idx];
+            }
+            else return nullptr;
+        }
+        return cur;
+    }
+
+    // Persistent updates: return a new version with one path changed. *this is untouched. The
+    // result shares every subtree off that path with it, so keeping many versions costs only the
+    // nodes along the edited paths.
+    // The last token may name a missing key, which is created, or be "-" or size() to append;
+    // everything above it must already exist ("JSON: bad pointer" otherwise).
+    Json set_in(std::string_view pointer, Json value) const {
+        Json root = *this;
+        *root.walk(pointer, true) = std::move(value);
+        return root;
+    }
+    Json erase_in(std::string_view pointer) const {
+        if (!find(pointer)) return *this;
+        size_t cut = pointer.rfind('/');
+        if (cut == std::string_view::npos) throw std::runtime_error("JSON: bad pointer");
+        std::string last;
+        std::string_view tail = pointer.substr(cut);
+        next_token(tail, last);
+        Json root = *this;
+        Json* parent = root.walk(pointer.substr(0, cut), false);
+        if (parent->is_object()) parent->object_mut().erase(last);
+        else {
+            size_t idx = 0;
+            parse_index(last, idx);
+            auto& a = parent->array_mut();
+            a.erase(a.begin() + static_cast<std::ptrdiff_t>(idx));
+        }
+        return root;
     }
 
+    // Resumable, bounded-memory serializer and scatter-gather output; defined below the class.
+    class Serializer;
+    class Gather;
+    // The reverse: elements of one big array, or a run of documents, parsed one at a time.
+    class ArrayStream;
+    class DocumentStream;
+    // On-demand reader that parses only what is asked for; defined below the class.
+    class Lazy;
+    // The same over a MessagePack buffer, handing out strings as views into it.
+    class MsgPackView;
+    // Reader over a freeze() image, and (POSIX) a read-only file mapping to put one under it.
+    class FrozenView;
+    class MappedFile;
+    // freeze() image published in POSIX shared memory for many processes to read; below the class.
+    class SharedSnapshot;
+
     // Serialization
     std::string dump(int indent = -1) const {
         std::string out;
+        out.reserve(size_impl(indent, 0, false)); // upper bound: skips formatting fractional numbers
         dump_impl(out, indent, 0);
         return out;
     }
+    // Exact byte length of dump(indent), computed without producing the output.
+    size_t serialized_size(int indent = -1) const { return size_impl(indent, 0); }
+    // Appends to out, so a buffer cleared and reused between calls stops allocating once warm.
+    void dump_to(std::string& out, int indent = -1) const { dump_impl(out, indent, 0); }
+    // Scatter-gather variant (see Json::Gather below); appends to g.
+    void dump_to(Gather& g, int indent = -1) const { dump_impl(g, indent, 0); }
+    // Writes through any output iterator (back_inserter, ostreambuf_iterator, char*...).
+    template <class OutIt>
+    OutIt dump_to(OutIt it, int indent = -1) const {
+        IterSink<OutIt> sink{ it };
+        dump_impl(sink, indent, 0);
+        return sink.it;
+    }
+
+    // Set of JSON Pointers compiled into a trie for the parser options below. A "*" token
+    // matches any key or array index. Compile once and reuse it across parses.
+    class PathMask {
+    public:
+        PathMask() = default;
+        PathMask(std::initializer_list<std::string_view> pointers) { for (auto p : pointers) add(p); }
+        explicit PathMask(const std::vector<std::string>& pointers) { for (const auto& p : pointers) add(p); }
+
+        void add(std::string_view pointer) {
+            PathMask* m = this;
+            std::string tok;
+            while (next_token(pointer, tok)) m = &m->kids_[tok];
+            m->leaf_ = true;
+        }
+        bool empty() const { return !leaf_ && kids_.empty(); }
+        // Number of distinct subtrees selected, or npos if a wildcard makes that open-ended.
+        size_t leaves() const {
+            if (leaf_) return 1;
+            size_t n = 0;
+            for (const auto& kv : kids_) {
+                size_t k = kv.first == "*" ? npos : kv.second.leaves();
+                if (k == npos) return npos;
+                n += k;
+            }
+            return n;
+        }
+        static constexpr size_t npos = static_cast<size_t>(-1);
+        // A pointer ends here: the whole subtree is selected.
+        bool leaf() const { return leaf_; }
+        const PathMask* child(std::string_view key) const {
+            auto it = kids_.find(key);
+            if (it == kids_.end()) it = kids_.find(std::string_view("*"));
+            return it == kids_.end() ? nullptr : &it->second;
+        }
+        const PathMask* child(size_t index) const {
+            char buf[24];
+            auto r = std::to_chars(buf, buf + sizeof(buf), index);
+            return child(std::string_view(buf, static_cast<size_t>(r.ptr - buf)));
+        }
+
+    private:
+        std::map<std::string, PathMask, std::less<>> kids_;
+        bool leaf_{ false };
+    };
+
+    struct ParseOptions {
+        // Subtrees kept as Raw text instead of being built. They are checked against the grammar
+        // like the rest of the input, without allocating.
+        PathMask raw;
+        // Keep numbers as source text and convert on as_num()/as_int(). Unread numbers cost one
+        // small string and round-trip through dump() byte for byte.
+        bool lazy_numbers{ false };
+        // Projection: only these subtrees are built. Everything else is still validated but
+        // skipped without allocating; unselected array elements become null.
+        PathMask only;
+        // Threads for parsing one large document (0: one per core). The input is cut between
+        // elements of its big arrays and the pieces are parsed side by side; the result, and any
+        // error, is the same as with one thread. Ignored with raw or only set, and when there is
+        // less than parallel_min_bytes of input per thread.
+        unsigned threads{ 1 };
+    };
+    static constexpr size_t parallel_min_bytes = size_t(1) << 20;
+
+    // Strict RFC 8259 check that builds nothing and allocates nothing: grammar, string escapes
+    // (including \uXXXX hex digits), raw control characters, number syntax and nesting depth,
+    // plus well-formed UTF-8 in strings unless turned off. Stricter than parse(), which accepts
+    // e.g. raw control characters in strings. String bodies are scanned 16 bytes at a time.
+    struct ValidateOptions {
+        bool utf8{ true };
+        size_t max_depth{ 1024 };
+    };
+    static bool validate(std::string_view s) { return validate(s, ValidateOptions()); }
+    static bool validate(std::string_view s, const ValidateOptions& opt) {
+        Validator v{ s.data(), s.data() + s.size(), opt.utf8, opt.max_depth };
+        if (!v.value()) return false;
+        v.ws();
+        return v.p == v.end;
+    }
 
-    // Parsing
-    static Json parse(std::string_view s) {
+    // Pulls selected fields out of a document and stops reading as soon as the last one has been
+    // built, so the cost depends on where the fields sit, not on the document size. The bytes
+    // after that point are not looked at unless validate is set. Fields the document lacks are
+    // simply absent from the result (and force a full read). Wildcard pointers never stop early.
+    //   Json r = Json::extract(body, { "/type", "/tenant" });
+    static Json extract(std::string_view s, const PathMask& fields, bool validate = false) {
         Parser p(s);
+        if (!validate) p.wanted = fields.leaves();
+        Json j = p.parse_value(nullptr, &fields);
+        if (p.wanted != 0) {
+            p.skip_ws();
+            if (!p.eof()) throw std::runtime_error("JSON: trailing characters");
+        }
+        return j;
+    }
+
+    // Input buffer followed by `padding` zero bytes, which lets parse() drop its per-byte end
+    // checks and scan strings 16 bytes at a time up to the very end. Reading straight into one
+    // (resize, then fill data()) and reusing it across messages avoids the copy parse(string_view)
+    // makes.
+    class PaddedString {
+    public:
+        static constexpr size_t padding = 64;
+
+        PaddedString() { resize(0); }
+        explicit PaddedString(std::string_view s) { assign(s); }
+
+        void assign(std::string_view s) {
+            resize(s.size());
+            if (!s.empty()) std::memcpy(&buf_[0], s.data(), s.size());
+        }
+        // Keeps the first min(n, size()) bytes; the rest of data()[0, n) is unspecified.
+        void resize(size_t n) {
+            buf_.resize(n);
+            buf_.append(padding, '\0');
+            size_ = n;
+        }
+        char* data() { return &buf_[0]; }
+        const char* data() const { return buf_.data(); }
+        size_t size() const { return size_; }
+        std::string_view view() const { return std::string_view(buf_.data(), size_); }
+
+    private:
+        std::string buf_;
+        size_t size_{ 0 };
+    };
+
+    // Parsing. The string_view overloads copy the input into a PaddedString first.
+    static Json parse(std::string_view s) { return parse(PaddedString(s)); }
+    static Json parse(std::string_view s, const ParseOptions& opt) { return parse(PaddedString(s), opt); }
+    static Json parse(const PaddedString& s) {
+        BasicParser<true> p(s.view());
         Json j = p.parse_value();
         p.skip_ws();
         if (!p.eof()) throw std::runtime_error("JSON: trailing characters");
         return j;
     }
+    static Json parse(const PaddedString& s, const ParseOptions& opt) {
+#if MINIJSON_THREADS
+        if (opt.threads != 1 && opt.raw.empty() && opt.only.empty()) {
+            size_t t = opt.threads ? opt.threads : std::thread::hardware_concurrency();
+            if (t > s.size() / parallel_min_bytes) t = s.size() / parallel_min_bytes;
+            if (t > 1) return parse_parallel(s, opt, t);
+        }
+#endif
+        BasicParser<true> p(s.view());
+        p.lazy_numbers = opt.lazy_numbers;
+        Json j = p.parse_value(opt.raw.empty() ? nullptr : &opt.raw, opt.only.empty() ? nullptr : &opt.only);
+        p.skip_ws();
+        if (!p.eof()) throw std::runtime_error("JSON: trailing characters");
+        return j;
+    }
+
+    // CBOR (RFC 8949). Integral numbers become the shortest integer head, others a float32 when
+    // that is exact and a float64 otherwise; lazy_numbers text that is an integer is encoded
+    // exactly even past 2^53. Raw fragments are parsed and re-encoded. to_cbor(out) appends, so
+    // a buffer cleared and reused between calls stops allocating once warm.
+    std::string to_cbor() const {
+        std::string out;
+        cbor_to(out);
+        return out;
+    }
+    void to_cbor(std::string& out) const { cbor_to(out); }
+    // Accepts definite and indefinite lengths. Integers beyond 2^53 come back as exact number
+    // text (as with lazy_numbers), byte strings as base64url text, tags are dropped and non-text
+    // map keys are converted to their JSON text, following RFC 8949 section 6.1.
+    static Json from_cbor(std::string_view data) {
+        CborReader r{ reinterpret_cast<const unsigned char*>(data.data()), reinterpret_cast<const unsigned char*>(data.data()) + data.size() };
+        Json j = r.value();
+        if (r.p != r.end) throw std::runtime_error("CBOR: trailing bytes");
+        return j;
+    }
+
+    // MessagePack, with the smallest integer and float encodings that hold each value (float32
+    // when exact). Exact integer text from lazy_numbers is kept exact, as with CBOR. Decoding
+    // maps bin and ext payloads to base64url text; Json::MsgPackView reads without copying.
+    std::string to_msgpack() const {
+        std::string out;
+        msgpack_to(out);
+        return out;
+    }
+    void to_msgpack(std::string& out) const { msgpack_to(out); }
+    static Json from_msgpack(std::string_view data) {
+        MsgPackReader r{ reinterpret_cast<const unsigned char*>(data.data()), reinterpret_cast<const unsigned char*>(data.data()) + data.size() };
+        Json j = r.value();
+        if (r.p != r.end) throw std::runtime_error("MsgPack: trailing bytes");
+        return j;
+    }
+
+    // Binary image of the tree that Json::FrozenView reads in place, e.g. straight from a mmap'd
+    // file, with nothing to deserialize. Containers hold 8-byte slots with offsets from the image
+    // start (so the image works at any address), object keys are sorted for binary search, and
+    // strings are deduplicated into 8-byte-aligned, NUL-terminated blocks. Native byte order;
+    // FrozenView rejects an image written with the other one. freeze(out) replaces out's contents.
+    std::string freeze() const {
+        std::string out;
+        freeze(out);
+        return out;
+    }
+    void freeze(std::string& out) const {
+        out.clear();
+        Freezer f{ out, {} };
+        f.alloc(frozen_header);
+        uint64_t root = f.slot(*this);
+        f.align();
+        uint64_t head[4] = { frozen_magic, out.size(), root, 0 };
+        std::memcpy(&out[0], head, sizeof(head));
+    }
+
+    // Implementations of the vectorized scans behind parsing, validate() and string escaping.
+    // The best one the CPU supports (cpuid on x86-64; NEON is always there on aarch64) is picked
+    // on first use. use_simd() forces one, e.g. to benchmark them against each other; it returns
+    // false and changes nothing if this build or CPU can't run it. Auto restores detection.
+    enum class Simd { Auto, Scalar, SSE2, AVX2, AVX512, NEON };
+    static bool use_simd(Simd s) {
+        if (s == Simd::Auto) s = best_simd();
+        const Kernel* k = kernel_for(s);
+        if (!k || !cpu_has(s)) return false;
+        active_kernel().store(k, std::memory_order_relaxed);
+        return true;
+    }
+    static Simd simd() { return kernel().kind; }
 
 private:
     Value v_;
 
-    static std::string escape(const std::string& s) {
-        std::string o;
-        o.reserve(s.size() + 4);
-        for (unsigned char c : s) {
+    // Detaching access for the library's own writes, which hand no reference out (see Shared).
+    Array& array_mut() { return std::get<Shared<Array>>(v_).mut(); }
+    Object& object_mut() { return std::get<Shared<Object>>(v_).mut(); }
+
+    // One set of scan routines. Parser and Validator copy the function pointers they need when
+    // constructed, so switching mid-parse is harmless.
+    using ScanFn = const char* (*)(const char*, const char*, bool);
+    using SkipFn = const char* (*)(const char*, const char*);
+    struct Kernel {
+        Simd kind;
+        ScanFn scan_string;
+        SkipFn skip_ws;
+    };
+
+    static const Kernel* kernel_for(Simd s) {
+        static const Kernel scalar{ Simd::Scalar, &scan_string_scalar, &skip_ws_scalar };
+#if MINIJSON_SSE2
+        static const Kernel sse2{ Simd::SSE2, &scan_string_sse2, &skip_ws_sse2 };
+#endif
+#if MINIJSON_AVX
+        static const Kernel avx2{ Simd::AVX2, &scan_string_avx2, &skip_ws_avx2 };
+        static const Kernel avx512{ Simd::AVX512, &scan_string_avx512, &skip_ws_avx512 };
+#endif
+#if MINIJSON_NEON
+        static const Kernel neon{ Simd::NEON, &scan_string_neon, &skip_ws_neon };
+#endif
+        switch (s) {
+        case Simd::Scalar: return &scalar;
+#if MINIJSON_SSE2
+        case Simd::SSE2: return &sse2;
+#endif
+#if MINIJSON_AVX
+        case Simd::AVX2: return &avx2;
+        case Simd::AVX512: return &avx512;
+#endif
+#if MINIJSON_NEON
+        case Simd::NEON: return &neon;
+#endif
+        default: return nullptr;
+        }
+    }
+    static bool cpu_has(Simd s) {
+#if MINIJSON_AVX
+        if (s != Simd::AVX2 && s != Simd::AVX512) return true;
+#if defined(_MSC_VER) && !defined(__clang__)
+        int r[4];
+        __cpuid(r, 0);
+        if (r[0] < 7) return false;
+        __cpuid(r, 1);
+        if (!(r[2] & (1 << 27))) return false; // OSXSAVE: needed to ask the OS which registers it saves
+        unsigned long long xcr0 = _xgetbv(0);
+        __cpuidex(r, 7, 0);
+        if (s == Simd::AVX2) return (r[1] & (1 << 5)) && (xcr0 & 0x6) == 0x6;
+        return (r[1] & (1 << 16)) && (r[1] & (1 << 30)) && (xcr0 & 0xE6) == 0xE6;
+#else
+        __builtin_cpu_init();
+        if (s == Simd::AVX2) return __builtin_cpu_supports("avx2");
+        return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+#endif
+#else
+        (void)s;
+        return true;
+#endif
+    }
+    static Simd best_simd() {
+        for (Simd s : { Simd::AVX512, Simd::AVX2, Simd::SSE2, Simd::NEON }) {
+            if (kernel_for(s) && cpu_has(s)) return s;
+        }
+        return Simd::Scalar;
+    }
+    static std::atomic<const Kernel*>& active_kernel() {
+        static std::atomic<const Kernel*> k{ kernel_for(best_simd()) };
+        return k;
+    }
+    static const Kernel& kernel() { return *active_kernel().load(std::memory_order_relaxed); }
+
+    // First byte in [p, end) that ends a plain run inside a string: '"', '\\', a control
+    // character, or (with high) any byte >= 0x80. Returns end if there is none.
+    static const char* scan_string(const char* p, const char* end, bool high) { return kernel().scan_string(p, end, high); }
+
+    static const char* scan_string_scalar(const char* p, const char* end, bool high) {
+        for (; p < end; ++p) {
+            unsigned char c = static_cast<unsigned char>(*p);
+            if (c == '"' || c == '\\' || c < 0x20 || (high && c >= 0x80)) return p;
+        }
+        return end;
+    }
+    // First byte in [p, end) that isn't JSON whitespace (space, \t, \n, \r), or end.
+    static const char* skip_ws_scalar(const char* p, const char* end) {
+        while (p < end && is_ws(*p)) ++p;
+        return p;
+    }
+#if MINIJSON_SSE2
+    static const char* scan_string_sse2(const char* p, const char* end, bool high) {
+        const __m128i quote = _mm_set1_epi8('"'), bslash = _mm_set1_epi8('\\');
+        const __m128i flip = _mm_set1_epi8(static_cast<char>(0x80)), ctl = _mm_set1_epi8(static_cast<char>(0x20 ^ 0x80));
+        for (; end - p >= 16; p += 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            __m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, bslash)),
+                                       _mm_cmplt_epi8(_mm_xor_si128(v, flip), ctl)); // unsigned v < 0x20
+            int mask = _mm_movemask_epi8(hit) | (high ? _mm_movemask_epi8(v) : 0);
+            if (mask) return p + ctz32(static_cast<unsigned>(mask));
+        }
+        return scan_string_scalar(p, end, high);
+    }
+    static const char* skip_ws_sse2(const char* p, const char* end) {
+        const __m128i sp = _mm_set1_epi8(' '), tab = _mm_set1_epi8('\t'), nl = _mm_set1_epi8('\n'), cr = _mm_set1_epi8('\r');
+        for (; end - p >= 16; p += 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            __m128i ws = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, sp), _mm_cmpeq_epi8(v, tab)),
+                                      _mm_or_si128(_mm_cmpeq_epi8(v, nl), _mm_cmpeq_epi8(v, cr)));
+            unsigned mask = ~static_cast<unsigned>(_mm_movemask_epi8(ws)) & 0xFFFFu;
+            if (mask) return p + ctz32(mask);
+        }
+        return skip_ws_scalar(p, end);
+    }
+#endif
+#if MINIJSON_AVX
+    MINIJSON_TARGET("avx2")
+    static const char* scan_string_avx2(const char* p, const char* end, bool high) {
+        const __m256i quote = _mm256_set1_epi8('"'), bslash = _mm256_set1_epi8('\\'), ctl = _mm256_set1_epi8(0x1F);
+        for (; end - p >= 32; p += 32) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+            __m256i hit = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, quote), _mm256_cmpeq_epi8(v, bslash)),
+                                          _mm256_cmpeq_epi8(_mm256_min_epu8(v, ctl), v)); // v <= 0x1F
+            unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(hit)) | (high ? static_cast<unsigned>(_mm256_movemask_epi8(v)) : 0u);
+            if (mask) return p + ctz32(mask);
+        }
+        return scan_string_sse2(p, end, high);
+    }
+    MINIJSON_TARGET("avx2")
+    static const char* skip_ws_avx2(const char* p, const char* end) {
+        const __m256i sp = _mm256_set1_epi8(' '), tab = _mm256_set1_epi8('\t'), nl = _mm256_set1_epi8('\n'), cr = _mm256_set1_epi8('\r');
+        for (; end - p >= 32; p += 32) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+            __m256i ws = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, sp), _mm256_cmpeq_epi8(v, tab)),
+                                         _mm256_or_si256(_mm256_cmpeq_epi8(v, nl), _mm256_cmpeq_epi8(v, cr)));
+            unsigned mask = ~static_cast<unsigned>(_mm256_movemask_epi8(ws));
+            if (mask) return p + ctz32(mask);
+        }
+        return skip_ws_sse2(p, end);
+    }
+    MINIJSON_TARGET("avx512f,avx512bw")
+    static const char* scan_string_avx512(const char* p, const char* end, bool high) {
+        const __m512i quote = _mm512_set1_epi8('"'), bslash = _mm512_set1_epi8('\\'), ctl = _mm512_set1_epi8(0x20);
+        for (; end - p >= 64; p += 64) {
+            __m512i v = _mm512_loadu_si512(p);
+            __mmask64 mask = _mm512_cmpeq_epi8_mask(v, quote) | _mm512_cmpeq_epi8_mask(v, bslash) | _mm512_cmplt_epu8_mask(v, ctl);
+            if (high) mask |= _mm512_movepi8_mask(v);
+            if (mask) return p + ctz64(mask);
+        }
+        return scan_string_avx2(p, end, high);
+    }
+    MINIJSON_TARGET("avx512f,avx512bw")
+    static const char* skip_ws_avx512(const char* p, const char* end) {
+        const __m512i sp = _mm512_set1_epi8(' '), tab = _mm512_set1_epi8('\t'), nl = _mm512_set1_epi8('\n'), cr = _mm512_set1_epi8('\r');
+        for (; end - p >= 64; p += 64) {
+            __m512i v = _mm512_loadu_si512(p);
+            uint64_t mask = ~static_cast<uint64_t>(_mm512_cmpeq_epi8_mask(v, sp) | _mm512_cmpeq_epi8_mask(v, tab) |
+                                                   _mm512_cmpeq_epi8_mask(v, nl) | _mm512_cmpeq_epi8_mask(v, cr));
+            if (mask) return p + ctz64(mask);
+        }
+        return skip_ws_avx2(p, end);
+    }
+#endif
+#if MINIJSON_NEON
+    static const char* scan_string_neon(const char* p, const char* end, bool high) {
+        const uint8x16_t quote = vdupq_n_u8('"'), bslash = vdupq_n_u8('\\'), ctl = vdupq_n_u8(0x20), top = vdupq_n_u8(0x80);
+        for (; end - p >= 16; p += 16) {
+            uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t*>(p));
+            uint8x16_t hit = vorrq_u8(vorrq_u8(vceqq_u8(v, quote), vceqq_u8(v, bslash)), vcltq_u8(v, ctl));
+            if (high) hit = vorrq_u8(hit, vcgeq_u8(v, top));
+            // narrow each 0x00/0xFF byte to a nibble, giving a 64-bit mask with 4 bits per byte
+            uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(hit), 4)), 0);
+            if (mask) return p + (ctz64(mask) >> 2);
+        }
+        return scan_string_scalar(p, end, high);
+    }
+    static const char* skip_ws_neon(const char* p, const char* end) {
+        const uint8x16_t sp = vdupq_n_u8(' '), tab = vdupq_n_u8('\t'), nl = vdupq_n_u8('\n'), cr = vdupq_n_u8('\r');
+        for (; end - p >= 16; p += 16) {
+            uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t*>(p));
+            uint8x16_t ws = vorrq_u8(vorrq_u8(vceqq_u8(v, sp), vceqq_u8(v, tab)), vorrq_u8(vceqq_u8(v, nl), vceqq_u8(v, cr)));
+            uint64_t mask = ~vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(ws), 4)), 0);
+            if (mask) return p + (ctz64(mask) >> 2);
+        }
+        return skip_ws_scalar(p, end);
+    }
+#endif
+    static int ctz32(unsigned x) {
+#if defined(_MSC_VER) && !defined(__clang__)
+        unsigned long i;
+        _BitScanForward(&i, x);
+        return static_cast<int>(i);
+#else
+        return __builtin_ctz(x);
+#endif
+    }
+    static int ctz64(uint64_t x) {
+#if defined(_MSC_VER) && !defined(__clang__)
+        unsigned long i;
+        _BitScanForward64(&i, x);
+        return static_cast<int>(i);
+#else
+        return __builtin_ctzll(x);
+#endif
+    }
+
+    // Backs validate(). Returns false instead of throwing so the check never allocates.
+    struct Validator {
+        const char* p;
+        const char* end;
+        bool utf8;
+        size_t max_depth;
+        size_t depth{ 0 };
+        ScanFn scan{ kernel().scan_string };
+        SkipFn skip{ kernel().skip_ws };
+
+        void ws() {
+            if (p == end || !is_ws(*p)) return;
+            if (++p < end && is_ws(*p)) p = skip(p, end);
+        }
+        bool lit(const char* w, size_t n) {
+            if (static_cast<size_t>(end - p) < n || std::memcmp(p, w, n) != 0) return false;
+            p += n;
+            return true;
+        }
+        bool digits() {
+            const char* start = p;
+            while (p < end && *p >= '0' && *p <= '9') ++p;
+            return p != start;
+        }
+        bool value() {
+            ws();
+            if (p == end) return false;
+            switch (*p) {
+            case '{': return object();
+            case '[': return array();
+            case '"': return string();
+            case 't': return lit("true", 4);
+            case 'f': return lit("false", 5);
+            case 'n': return lit("null", 4);
+            default: return number();
+            }
+        }
+        bool number() {
+            if (*p == '-') ++p;
+            if (p < end && *p == '0') ++p;
+            else if (!digits()) return false;
+            if (p < end && *p == '.') { ++p; if (!digits()) return false; }
+            if (p < end && (*p == 'e' || *p == 'E')) {
+                ++p;
+                if (p < end && (*p == '+' || *p == '-')) ++p;
+                if (!digits()) return false;
+            }
+            return true;
+        }
+        bool string() {
+            ++p; // opening quote
+            while (true) {
+                p = scan(p, end, utf8);
+                if (p == end) return false;
+                unsigned char c = static_cast<unsigned char>(*p);
+                if (c == '"') { ++p; return true; }
+                if (c < 0x20) return false;
+                if (c == '\\') { if (!escape()) return false; }
+                else if (!utf8_seq()) return false;
+            }
+        }
+        bool escape() {
+            if (end - p < 2) return false;
+            char e = p[1];
+            p += 2;
+            switch (e) {
+            case '"': case '\\': case '/': case 'b': case 'f': case 'n': case 'r': case 't': return true;
+            case 'u':
+                if (end - p < 4) return false;
+                for (int k = 0; k < 4; ++k, ++p) {
+                    if (!is_hex(*p)) return false;
+                }
+                return true;
+            default: return false;
+            }
+        }
+        // One multi-byte UTF-8 sequence: no overlongs, surrogates or code points past U+10FFFF.
+        bool utf8_seq() {
+            unsigned char c = static_cast<unsigned char>(*p);
+            size_t n;
+            unsigned char lo = 0x80, hi = 0xBF; // allowed range of the second byte
+            if (c >= 0xC2 && c <= 0xDF) n = 2;
+            else if (c >= 0xE0 && c <= 0xEF) { n = 3; if (c == 0xE0) lo = 0xA0; if (c == 0xED) hi = 0x9F; }
+            else if (c >= 0xF0 && c <= 0xF4) { n = 4; if (c == 0xF0) lo = 0x90; if (c == 0xF4) hi = 0x8F; }
+            else return false;
+            if (static_cast<size_t>(end - p) < n) return false;
+            unsigned char c1 = static_cast<unsigned char>(p[1]);
+            if (c1 < lo || c1 > hi) return false;
+            for (size_t k = 2; k < n; ++k) {
+                if ((static_cast<unsigned char>(p[k]) & 0xC0) != 0x80) return false;
+            }
+            p += n;
+            return true;
+        }
+        bool array() {
+            if (++depth > max_depth) return false;
+            ++p; ws();
+            if (p < end && *p == ']') { ++p; --depth; return true; }
+            while (true) {
+                if (!value()) return false;
+                ws();
+                if (p == end) return false;
+                char c = *p++;
+                if (c == ']') break;
+                if (c != ',') return false;
+            }
+            --depth;
+            return true;
+        }
+        bool object() {
+            if (++depth > max_depth) return false;
+            ++p; ws();
+            if (p < end && *p == '}') { ++p; --depth; return true; }
+            while (true) {
+                ws();
+                if (p == end || *p != '"' || !string()) return false;
+                ws();
+                if (p == end || *p++ != ':') return false;
+                if (!value()) return false;
+                ws();
+                if (p == end) return false;
+                char c = *p++;
+                if (c == '}') break;
+                if (c != ',') return false;
+            }
+            --depth;
+            return true;
+        }
+    };
+
+    // from_chars ignores the C locale, which may want a decimal comma; stod is the fallback.
+    static double to_double(std::string_view text) {
+#if defined(__cpp_lib_to_chars)
+        double d = 0;
+        auto r = std::from_chars(text.data(), text.data() + text.size(), d);
+        if (r.ec == std::errc::result_out_of_range) throw std::out_of_range("JSON: number out of range");
+        if (r.ec != std::errc() || r.ptr != text.data() + text.size()) throw std::invalid_argument("JSON: bad number");
+        return d;
+#else
+        return std::stod(std::string(text));
+#endif
+    }
+    // Integer text whose magnitude fits a uint64 ("-0" doesn't count: it is a double).
+    static bool text_integer(std::string_view text, bool& negative, uint64_t& magnitude) {
+        const char* b = text.data();
+        const char* e = b + text.size();
+        negative = b != e && *b == '-';
+        magnitude = 0;
+        auto r = std::from_chars(b + negative, e, magnitude);
+        return r.ec == std::errc() && r.ptr == e && (!negative || magnitude != 0);
+    }
+    // The source text of a lazy number, unless the number was changed through as_num().
+    const NumberText* number_text() const {
+        auto* t = std::get_if<NumberText>(&v_);
+        if (!t || !t->parsed) return t;
+        double d = to_double(t->text);
+        return std::memcmp(&d, &t->num, sizeof(d)) == 0 ? t : nullptr;
+    }
+    // Truncates d to an int64; out-of-range values and NaN would be undefined behaviour to cast.
+    static int64_t to_int64(double d, const char* format) {
+        if (!(d >= -9223372036854775808.0 && d < 9223372036854775808.0)) throw std::runtime_error(std::string(format) + ": number out of int64 range");
+        return static_cast<int64_t>(d);
+    }
+
+    // Pops the next reference token off a JSON Pointer, unescaping ~1 and ~0.
+    static bool next_token(std::string_view& p, std::string& tok) {
+        if (p.empty()) return false;
+        if (p[0] != '/') throw std::runtime_error("JSON: bad pointer");
+        size_t end = p.find('/', 1);
+        std::string_view raw = p.substr(1, end == std::string_view::npos ? std::string_view::npos : end - 1);
+        p = end == std::string_view::npos ? std::string_view() : p.substr(end);
+        tok.clear();
+        for (size_t k = 0; k < raw.size(); ++k) {
+            if (raw[k] == '~' && k + 1 < raw.size() && (raw[k + 1] == '0' || raw[k + 1] == '1')) {
+                tok += raw[++k] == '0' ? '~' : '/';
+            }
+            else tok += raw[k];
+        }
+        return true;
+    }
+    static bool parse_index(const std::string& tok, size_t& idx) {
+        if (tok.empty() || (tok.size() > 1 && tok[0] == '0')) return false;
+        idx = 0;
+        for (char c : tok) {
+            if (c < '0' || c > '9') return false;
+            idx = idx * 10 + static_cast<size_t>(c - '0');
+        }
+        return true;
+    }
+
+    // Descends, detaching each node on the way down but not exposing it: the pointer returned is
+    // only used inside set_in/erase_in, so their results stay shareable. With create,
+    // the last token may add a key to an object or append to an array; every other step must
+    // exist, so a scalar on the path is never replaced by a container.
+    Json* walk(std::string_view pointer, bool create) {
+        Json* cur = this;
+        std::string tok;
+        while (next_token(pointer, tok)) {
+            if (cur->is_array()) {
+                auto& a = cur->array_mut();
+                size_t idx = a.size();
+                if (tok != "-" && !parse_index(tok, idx)) throw std::runtime_error("JSON: bad pointer");
+                if (idx == a.size() && create && pointer.empty()) a.emplace_back();
+                if (idx >= a.size()) throw std::runtime_error("JSON: bad pointer");
+                cur = &a[idx];
+            }
+            else if (cur->is_object() && ((create && pointer.empty()) || cur->contains(tok))) cur = &cur->object_mut()[tok];
+            else throw std::runtime_error("JSON: bad pointer");
+        }
+        return cur;
+    }
+
+    // Adapts an output iterator to the append/push_back interface dump_impl writes through.
+    template <class OutIt>
+    struct IterSink {
+        OutIt it;
+        void push_back(char c) { *it++ = c; }
+        void append(const char* p, size_t n) { for (size_t k = 0; k < n; ++k) *it++ = p[k]; }
+        void append(size_t n, char c) { for (size_t k = 0; k < n; ++k) *it++ = c; }
+    };
+
+    // Formats like ostream with precision(15) (i.e. %.15g), without a stream or heap allocation.
+    static size_t format_num(double d, char (&buf)[32]) {
+#if defined(__cpp_lib_to_chars)
+        return static_cast<size_t>(std::to_chars(buf, buf + sizeof(buf), d, std::chars_format::general, 15).ptr - buf);
+#else
+        int n = std::snprintf(buf, sizeof(buf), "%.15g", d);
+        return n > 0 ? static_cast<size_t>(n) : 0;
+#endif
+    }
+
+    template <class Out>
+    static void escape_to(Out& o, std::string_view s) {
+        static const char* hex = "0123456789ABCDEF";
+        ScanFn scan = kernel().scan_string;
+        const char* p = s.data();
+        const char* end = p + s.size();
+        while (true) {
+            const char* q = scan(p, end, false); // end of the run of bytes that need no escaping
+            o.append(p, static_cast<size_t>(q - p));
+            if (q == end) return;
+            unsigned char c = static_cast<unsigned char>(*q);
+            p = q + 1;
             switch (c) {
-            case '\"': o += "\\\""; break;
-            case '\\': o += "\\\\"; break;
-            case '\b': o += "\\b";  break;
-            case '\f': o += "\\f";  break;
-            case '\n': o += "\\n";  break;
-            case '\r': o += "\\r";  break;
-            case '\t': o += "\\t";  break;
-            default:
+            case '\"': o.append("\\\"", 2); break;
+            case '\\': o.append("\\\\", 2); break;
+            case '\b': o.append("\\b", 2);  break;
+            case '\f': o.append("\\f", 2);  break;
+            case '\n': o.append("\\n", 2);  break;
+            case '\r': o.append("\\r", 2);  break;
+            case '\t': o.append("\\t", 2);  break;
+            default: {
             // control chars -> \u00XX
-                if (c < 0x20) { 
-                    static const char* hex = "0123456789ABCDEF";
-                    o += "\\u00";
-                    o += hex[(c >> 4) & 0xF];
-                    o += hex[c & 0xF];
-                }
-                else {
-                    o += static_cast<char>(c);
-                }
+                char u[6] = { '\\', 'u', '0', '0', hex[(c >> 4) & 0xF], hex[c & 0xF] };
+                o.append(u, 6);
+            }
+            }
+        }
+    }
+
+    // Bytes each input byte expands to inside a quoted string (see escape_to).
+    static size_t escaped_size(std::string_view s) {
+        ScanFn scan = kernel().scan_string;
+        size_t n = s.size();
+        for (const char *p = s.data(), *end = p + s.size(); (p = scan(p, end, false)) != end; ++p) {
+            unsigned char c = static_cast<unsigned char>(*p);
+            n += (c == '\"' || c == '\\' || c == '\b' || c == '\f' || c == '\n' || c == '\r' || c == '\t') ? 1 : 5;
+        }
+        return n;
+    }
+    // Exact length of d as dump() prints it; with exact unset, fractional values get the %.15g
+    // maximum (22 bytes, e.g. -1.23456789012345e-308) rounded up instead of being formatted.
+    static size_t num_size(double d, bool exact = true) {
+        // integers below 1e15 print as plain digits under %.15g; count them instead of formatting
+        if (d > -1e15 && d < 1e15 && d == static_cast<double>(static_cast<long long>(d))) {
+            long long v = static_cast<long long>(d);
+            size_t n = (v < 0 || (v == 0 && std::signbit(d))) ? 2 : 1;
+            for (v = v < 0 ? -v : v; v >= 10; v /= 10) ++n;
+            return n;
+        }
+        if (!exact) return 24;
+        char buf[32];
+        return format_num(d, buf);
+    }
+
+    size_t size_impl(int indent, int depth, bool exact = true) const {
+        size_t pad = indent >= 0 ? static_cast<size_t>(indent) : 0;
+        size_t nl = indent >= 0 ? 1 : 0;
+
+        if (is_null()) return 4;
+        if (is_bool()) return as_bool() ? 4 : 5;
+        if (auto* t = number_text()) return t->text.size();
+        if (is_num()) return num_size(as_num(), exact);
+        if (is_str()) return escaped_size(as_str()) + 2;
+        if (is_raw()) return as_raw().size();
+        if (const DumpCache* c = dump_cache(); c && c->fresh(indent, depth)) return c->text.size();
+
+        size_t n = 2, count = 0;
+        if (is_array()) {
+            for (const auto& v : as_array()) { n += v.size_impl(indent, depth + 1, exact); ++count; }
+        }
+        else {
+            for (const auto& kv : as_object()) {
+                n += escaped_size(kv.first) + 3 + nl + kv.second.size_impl(indent, depth + 1, exact);
+                ++count;
             }
         }
-        return o;
+        if (count == 0) return n;
+        // per element: indentation, newline, separating comma; plus the opening newline and closing indent
+        return n + count * (pad * (depth + 1) + nl) + (count - 1) + nl + pad * depth;
+    }
+
+    template <class Out>
+    static void put_str(Out& out, std::string_view s) {
+        if constexpr (std::is_same_v<Out, Gather>) out.string_body(s);
+        else escape_to(out, s);
+    }
+    template <class Out>
+    static void put_raw(Out& out, std::string_view s) {
+        if constexpr (std::is_same_v<Out, Gather>) out.raw(s);
+        else out.append(s.data(), s.size());
     }
 
-    void dump_impl(std::string& out, int indent, int depth) const {
-        auto ind = [&](int d) { if (indent >= 0) out.append(d * indent, ' '); };
+    DumpCache* dump_cache() const {
+        if (is_array()) return std::get<Shared<Array>>(v_).cache();
+        if (is_object()) return std::get<Shared<Object>>(v_).cache();
+        return nullptr;
+    }
 
-        if (is_null()) { out += "null"; return; }
-        if (is_bool()) { out += as_bool() ? "true" : "false"; return; }
+    template <class Out>
+    void dump_impl(Out& out, int indent, int depth) const {
+        if (is_null()) { out.append("null", 4); return; }
+        if (is_bool()) { if (as_bool()) out.append("true", 4); else out.append("false", 5); return; }
+        if (auto* t = number_text()) { out.append(t->text.data(), t->text.size()); return; }
         if (is_num()) {
-            // avoids trailing .000000
-            std::ostringstream oss; oss.precision(15); oss << as_num();
-            out += oss.str(); return;
+            char buf[32];
+            out.append(buf, format_num(as_num(), buf)); return;
+        }
+        if (is_str()) { out.push_back('\"'); put_str(out, as_str()); out.push_back('\"'); return; }
+        if (is_raw()) { put_raw(out, as_raw()); return; }
+
+        if (DumpCache* c = dump_cache()) {
+            if (!c->fresh(indent, depth)) {
+                c->text.clear();
+                dump_container(c->text, indent, depth);
+                c->indent = indent; c->depth = depth; c->valid = true;
+            }
+            out.append(c->text.data(), c->text.size());
+            return;
         }
-        if (is_str()) { out += '\"'; out += escape(as_str()); out += '\"'; return; }
+        dump_container(out, indent, depth);
+    }
+
+    template <class Out>
+    void dump_container(Out& out, int indent, int depth) const {
+        auto ind = [&](int d) { if (indent >= 0) out.append(static_cast<size_t>(d * indent), ' '); };
 
         if (is_array()) {
             const auto& a = as_array();
-            out += '[';
+            out.push_back('[');
             if (!a.empty()) {
-                if (indent >= 0) out += '\n';
+                if (indent >= 0) out.push_back('\n');
                 for (size_t i = 0; i < a.size(); ++i) {
                     ind(depth + 1);
                     a[i].dump_impl(out, indent, depth + 1);
-                    if (i + 1 < a.size()) out += ',';
-                    if (indent >= 0) out += '\n';
+                    if (i + 1 < a.size()) out.push_back(',');
+                    if (indent >= 0) out.push_back('\n');
                 }
                 ind(depth);
             }
-            out += ']';
+            out.push_back(']');
             return;
         }
 
         // object
         const auto& o = as_object();
-        out += '{';
+        out.push_back('{');
         if (!o.empty()) {
-            if (indent >= 0) out += '\n';
+            if (indent >= 0) out.push_back('\n');
             size_t i = 0;
             for (const auto& kv : o) {
                 ind(depth + 1);
-                out += '\"'; out += escape(kv.first); out += "\":";
-                if (indent >= 0) out += ' ';
+                out.push_back('\"'); put_str(out, kv.first); out.append("\":", 2);
+                if (indent >= 0) out.push_back(' ');
                 kv.second.dump_impl(out, indent, depth + 1);
-                if (++i < o.size()) out += ',';
-                if (indent >= 0) out += '\n';
+                if (++i < o.size()) out.push_back(',');
+                if (indent >= 0) out.push_back('\n');
             }
             ind(depth);
         }
-        out += '}';
+        out.push_back('}');
     }
 
-    //Minimal recursive-descent parser 
-    struct Parser {
-        std::string_view s;
-        size_t i{ 0 };
-        Parser(std::string_view sv) : s(sv) {}
+    // Major type + argument, in the shortest form.
+    static void cbor_head(std::string& out, unsigned major, uint64_t n) {
+        unsigned char m = static_cast<unsigned char>(major << 5);
+        if (n < 24) { out.push_back(static_cast<char>(m | n)); return; }
+        int bytes = n <= 0xFF ? 1 : n <= 0xFFFF ? 2 : n <= 0xFFFFFFFFu ? 4 : 8;
+        out.push_back(static_cast<char>(m | (bytes == 1 ? 24 : bytes == 2 ? 25 : bytes == 4 ? 26 : 27)));
+        for (int k = bytes - 1; k >= 0; --k) out.push_back(static_cast<char>(n >> (8 * k)));
+    }
+    static void cbor_int(std::string& out, bool negative, uint64_t magnitude) {
+        // major 1 stores -1 - value, i.e. magnitude - 1
+        if (negative) cbor_head(out, 1, magnitude - 1);
+        else cbor_head(out, 0, magnitude);
+    }
+    static void cbor_num(std::string& out, double d) {
+        if (d == std::floor(d) && d > -18446744073709551616.0 && d < 18446744073709551616.0 && !(d == 0 && std::signbit(d))) {
+            if (d >= 0) cbor_int(out, false, static_cast<uint64_t>(d));
+            else cbor_int(out, true, static_cast<uint64_t>(-d));
+            return;
+        }
+        float f = static_cast<float>(d);
+        if (static_cast<double>(f) == d || d != d) {
+            uint32_t bits;
+            std::memcpy(&bits, &f, 4);
+            out.push_back(static_cast<char>(0xFA));
+            for (int k = 3; k >= 0; --k) out.push_back(static_cast<char>(bits >> (8 * k)));
+            return;
+        }
+        uint64_t bits;
+        std::memcpy(&bits, &d, 8);
+        out.push_back(static_cast<char>(0xFB));
+        for (int k = 7; k >= 0; --k) out.push_back(static_cast<char>(bits >> (8 * k)));
+    }
+    static void cbor_str(std::string& out, std::string_view s) {
+        cbor_head(out, 3, s.size());
+        out.append(s.data(), s.size());
+    }
 
-        bool eof() const { return i >= s.size(); }
-        char peek() const { return eof() ? '\0' : s[i]; }
-        char get() { return eof() ? '\0' : s[i++]; }
-        void skip_ws() { while (!eof() && std::isspace((unsigned char)peek())) ++i; }
-        void expect(char c) {
-            if (get() != c) throw std::runtime_error(std::string("JSON: expected '") + c + "'");
+    void cbor_to(std::string& out) const {
+        if (is_null()) { out.push_back(static_cast<char>(0xF6)); return; }
+        if (is_bool()) { out.push_back(static_cast<char>(as_bool() ? 0xF5 : 0xF4)); return; }
+        if (auto* t = number_text()) {
+            bool neg;
+            uint64_t u;
+            if (text_integer(t->text, neg, u)) { cbor_int(out, neg, u); return; }
+            cbor_num(out, as_num());
+            return;
+        }
+        if (is_num()) { cbor_num(out, as_num()); return; }
+        if (is_str()) { cbor_str(out, as_str()); return; }
+        if (is_raw()) { parse(as_raw()).cbor_to(out); return; }
+        if (is_array()) {
+            cbor_head(out, 4, as_array().size());
+            for (const auto& v : as_array()) v.cbor_to(out);
+            return;
         }
+        cbor_head(out, 5, as_object().size());
+        for (const auto& kv : as_object()) {
+            cbor_str(out, kv.first);
+            kv.second.cbor_to(out);
+        }
+    }
 
-        Json parse_value() {
-            skip_ws();
-            char c = peek();
-            if (c == 'n') return parse_null();
-            if (c == 't' || c == 'f') return parse_bool();
-            if (c == '"') return parse_string();
-            if (c == '-' || std::isdigit((unsigned char)c)) return parse_number();
-            if (c == '{') return parse_object();
-            if (c == '[') return parse_array();
-            throw std::runtime_error("JSON: unexpected token");
+    static void put_be(std::string& out, uint64_t v, int bytes) {
+        for (int k = bytes - 1; k >= 0; --k) out.push_back(static_cast<char>(v >> (8 * k)));
+    }
+    // Type byte followed by a big-endian length, picking the first width (1, 2, 4 bytes) that fits.
+    static void msgpack_len(std::string& out, uint64_t n, unsigned char t8, unsigned char t16, unsigned char t32) {
+        if (t8 && n <= 0xFF) { out.push_back(static_cast<char>(t8)); put_be(out, n, 1); }
+        else if (n <= 0xFFFF) { out.push_back(static_cast<char>(t16)); put_be(out, n, 2); }
+        else { out.push_back(static_cast<char>(t32)); put_be(out, n, 4); }
+    }
+    static void msgpack_int(std::string& out, bool negative, uint64_t magnitude) {
+        if (!negative) {
+            if (magnitude < 0x80) out.push_back(static_cast<char>(magnitude));
+            else if (magnitude <= 0xFF) { out.push_back(static_cast<char>(0xCC)); put_be(out, magnitude, 1); }
+            else if (magnitude <= 0xFFFF) { out.push_back(static_cast<char>(0xCD)); put_be(out, magnitude, 2); }
+            else if (magnitude <= 0xFFFFFFFFu) { out.push_back(static_cast<char>(0xCE)); put_be(out, magnitude, 4); }
+            else { out.push_back(static_cast<char>(0xCF)); put_be(out, magnitude, 8); }
+            return;
+        }
+        uint64_t v = ~(magnitude - 1); // two's complement of -magnitude
+        if (magnitude <= 32) out.push_back(static_cast<char>(v));
+        else if (magnitude <= 0x80) { out.push_back(static_cast<char>(0xD0)); put_be(out, v, 1); }
+        else if (magnitude <= 0x8000) { out.push_back(static_cast<char>(0xD1)); put_be(out, v, 2); }
+        else if (magnitude <= 0x80000000u) { out.push_back(static_cast<char>(0xD2)); put_be(out, v, 4); }
+        else { out.push_back(static_cast<char>(0xD3)); put_be(out, v, 8); }
+    }
+    static void msgpack_num(std::string& out, double d) {
+        if (d == std::floor(d) && d >= -9223372036854775808.0 && d < 18446744073709551616.0 && !(d == 0 && std::signbit(d))) {
+            if (d >= 0) msgpack_int(out, false, static_cast<uint64_t>(d));
+            else msgpack_int(out, true, static_cast<uint64_t>(-d));
+            return;
         }
+        float f = static_cast<float>(d);
+        if (static_cast<double>(f) == d || d != d) {
+            uint32_t bits;
+            std::memcpy(&bits, &f, 4);
+            out.push_back(static_cast<char>(0xCA));
+            put_be(out, bits, 4);
+            return;
+        }
+        uint64_t bits;
+        std::memcpy(&bits, &d, 8);
+        out.push_back(static_cast<char>(0xCB));
+        put_be(out, bits, 8);
+    }
+    static void msgpack_str(std::string& out, std::string_view s) {
+        if (s.size() < 32) out.push_back(static_cast<char>(0xA0 | s.size()));
+        else msgpack_len(out, s.size(), 0xD9, 0xDA, 0xDB);
+        out.append(s.data(), s.size());
+    }
 
-        Json parse_null() {
-            expect('n'); expect('u'); expect('l'); expect('l'); return Json(nullptr);
+    void msgpack_to(std::string& out) const {
+        if (is_null()) { out.push_back(static_cast<char>(0xC0)); return; }
+        if (is_bool()) { out.push_back(static_cast<char>(as_bool() ? 0xC3 : 0xC2)); return; }
+        if (auto* t = number_text()) {
+            bool neg;
+            uint64_t u;
+            if (text_integer(t->text, neg, u) && (!neg || u <= (1ull << 63))) { msgpack_int(out, neg, u); return; }
+            msgpack_num(out, as_num());
+            return;
         }
-        Json parse_bool() {
-            if (peek() == 't') { expect('t'); expect('r'); expect('u'); expect('e'); return Json(true); }
-            expect('f'); expect('a'); expect('l'); expect('s'); expect('e'); return Json(false);
+        if (is_num()) { msgpack_num(out, as_num()); return; }
+        if (is_str()) { msgpack_str(out, as_str()); return; }
+        if (is_raw()) { parse(as_raw()).msgpack_to(out); return; }
+        if (is_array()) {
+            const auto& a = as_array();
+            if (a.size() < 16) out.push_back(static_cast<char>(0x90 | a.size()));
+            else msgpack_len(out, a.size(), 0, 0xDC, 0xDD);
+            for (const auto& v : a) v.msgpack_to(out);
+            return;
         }
-        Json parse_number() {
-            size_t start = i;
-            if (peek() == '-') ++i;
-            if (peek() == '0') { ++i; }
-            else {
-                if (!std::isdigit((unsigned char)peek())) throw std::runtime_error("JSON: bad number");
-                while (std::isdigit((unsigned char)peek())) ++i;
+        const auto& o = as_object();
+        if (o.size() < 16) out.push_back(static_cast<char>(0x80 | o.size()));
+        else msgpack_len(out, o.size(), 0, 0xDE, 0xDF);
+        for (const auto& kv : o) {
+            msgpack_str(out, kv.first);
+            kv.second.msgpack_to(out);
+        }
+    }
+
+    // Backs from_msgpack() and MsgPackView. head() decodes one item's type byte and length or
+    // scalar value; the payload of str/bin/ext (n bytes) or the n items of an array (2n for a map)
+    // follow at p.
+    enum MsgPackKind : unsigned char { MpNil, MpBool, MpUint, MpInt, MpFloat, MpStr, MpBin, MpExt, MpArray, MpMap };
+    struct MsgPackHead {
+        MsgPackKind kind;
+        uint64_t n; // bool, uint, int (two's complement) value; byte or item count otherwise
+        double d;
+    };
+    struct MsgPackReader {
+        const unsigned char* p;
+        const unsigned char* end;
+        size_t depth{ 0 };
+        static constexpr size_t max_depth = 1024;
+
+        void need(uint64_t n) const {
+            if (static_cast<uint64_t>(end - p) < n) throw std::runtime_error("MsgPack: truncated input");
+        }
+        uint64_t be(int n) {
+            need(static_cast<uint64_t>(n));
+            uint64_t v = 0;
+            for (int k = 0; k < n; ++k) v = (v << 8) | *p++;
+            return v;
+        }
+        MsgPackHead sized(MsgPackKind k, uint64_t n) {
+            if (k == MpExt) be(1); // ext type, dropped
+            return { k, n, 0 };
+        }
+        MsgPackHead head() {
+            need(1);
+            unsigned char t = *p++;
+            if (t < 0x80) return { MpUint, t, 0 };
+            if (t >= 0xE0) return { MpInt, static_cast<uint64_t>(static_cast<int64_t>(static_cast<int8_t>(t))), 0 };
+            if (t < 0x90) return { MpMap, t & 0x0Fu, 0 };
+            if (t < 0xA0) return { MpArray, t & 0x0Fu, 0 };
+            if (t < 0xC0) return { MpStr, t & 0x1Fu, 0 };
+            switch (t) {
+            case 0xC0: return { MpNil, 0, 0 };
+            case 0xC2: case 0xC3: return { MpBool, t == 0xC3u, 0 };
+            case 0xC4: return sized(MpBin, be(1));
+            case 0xC5: return sized(MpBin, be(2));
+            case 0xC6: return sized(MpBin, be(4));
+            case 0xC7: return sized(MpExt, be(1));
+            case 0xC8: return sized(MpExt, be(2));
+            case 0xC9: return sized(MpExt, be(4));
+            case 0xCA: {
+                uint32_t bits = static_cast<uint32_t>(be(4));
+                float f;
+                std::memcpy(&f, &bits, 4);
+                return { MpFloat, 0, f };
+            }
+            case 0xCB: {
+                uint64_t bits = be(8);
+                double d;
+                std::memcpy(&d, &bits, 8);
+                return { MpFloat, 0, d };
+            }
+            case 0xCC: return { MpUint, be(1), 0 };
+            case 0xCD: return { MpUint, be(2), 0 };
+            case 0xCE: return { MpUint, be(4), 0 };
+            case 0xCF: return { MpUint, be(8), 0 };
+            case 0xD0: return { MpInt, static_cast<uint64_t>(static_cast<int64_t>(static_cast<int8_t>(be(1)))), 0 };
+            case 0xD1: return { MpInt, static_cast<uint64_t>(static_cast<int64_t>(static_cast<int16_t>(be(2)))), 0 };
+            case 0xD2: return { MpInt, static_cast<uint64_t>(static_cast<int64_t>(static_cast<int32_t>(be(4)))), 0 };
+            case 0xD3: return { MpInt, be(8), 0 };
+            case 0xD4: case 0xD5: case 0xD6: case 0xD7: case 0xD8: return sized(MpExt, 1u << (t - 0xD4));
+            case 0xD9: return { MpStr, be(1), 0 };
+            case 0xDA: return { MpStr, be(2), 0 };
+            case 0xDB: return { MpStr, be(4), 0 };
+            case 0xDC: return { MpArray, be(2), 0 };
+            case 0xDD: return { MpArray, be(4), 0 };
+            case 0xDE: return { MpMap, be(2), 0 };
+            case 0xDF: return { MpMap, be(4), 0 };
+            default: throw std::runtime_error("MsgPack: reserved type byte");
             }
-            if (peek() == '.') { ++i; if (!std::isdigit((unsigned char)peek())) throw std::runtime_error("JSON: bad number"); while (std::isdigit((unsigned char)peek())) ++i; }
-            if (peek() == 'e' || peek() == 'E') { ++i; if (peek() == '+' || peek() == '-') ++i; if (!std::isdigit((unsigned char)peek())) throw std::runtime_error("JSON: bad number"); while (std::isdigit((unsigned char)peek())) ++i; }
-            double d = std::stod(std::string(s.substr(start, i - start)));
-            return Json(d);
         }
-        Json parse_string() {
-            expect('"');
-            std::string out;
-            while (!eof()) {
-                char c = get();
-                if (c == '"') break;
-                if (c == '\\') {
-                    char e = get();
-                    switch (e) {
-                    case '"':  out += '"';  break;
-                    case '\\': out += '\\'; break;
-                    case '/':  out += '/';  break;
-                    case 'b':  out += '\b'; break;
-                    case 'f':  out += '\f'; break;
+        std::string_view payload(uint64_t n) {
+            need(n);
+            std::string_view v(reinterpret_cast<const char*>(p), static_cast<size_t>(n));
+            p += n;
+            return v;
+        }
+        // Items that follow a container head; each takes at least one byte.
+        uint64_t items(const MsgPackHead& h) {
+            if (++depth > max_depth) throw std::runtime_error("MsgPack: nesting too deep");
+            uint64_t n = h.kind == MpMap ? 2 * h.n : h.n;
+            need(n);
+            return n;
+        }
+        void skip() {
+            MsgPackHead h = head();
+            if (h.kind == MpStr || h.kind == MpBin || h.kind == MpExt) payload(h.n);
+            else if (h.kind == MpArray || h.kind == MpMap) {
+                for (uint64_t k = items(h); k > 0; --k) skip();
+                --depth;
+            }
+        }
+        Json value() {
+            MsgPackHead h = head();
+            switch (h.kind) {
+            case MpNil: return Json(nullptr);
+            case MpBool: return Json(h.n != 0);
+            case MpUint: return exact_integer(false, h.n);
+            case MpInt: return static_cast<int64_t>(h.n) < 0 ? exact_integer(true, ~h.n) : exact_integer(false, h.n);
+            case MpFloat: return Json(h.d);
+            case MpStr: return Json(std::string(payload(h.n)));
+            case MpBin: case MpExt: return Json(base64url(payload(h.n)));
+            case MpArray: {
+                items(h);
+                Array a;
+                a.reserve(static_cast<size_t>(h.n));
+                for (uint64_t k = 0; k < h.n; ++k) a.push_back(value());
+                --depth;
+                return Json(std::move(a));
+            }
+            default: {
+                items(h);
+                Object o;
+                std::string scratch;
+                for (uint64_t k = 0; k < h.n; ++k) {
+                    std::string key(map_key(scratch));
+                    o.emplace(std::move(key), value());
+                }
+                --depth;
+                return Json(std::move(o));
+            }
+            }
+        }
+        // Map keys are normally str and returned in place; anything else is keyed by its JSON
+        // text, built in scratch.
+        std::string_view map_key(std::string& scratch) {
+            const unsigned char* at = p;
+            MsgPackHead h = head();
+            if (h.kind == MpStr) return payload(h.n);
+            p = at;
+            scratch = value().dump();
+            return scratch;
+        }
+        // Writes the next item as compact JSON text directly, without building a tree.
+        void to_json(std::string& out) {
+            MsgPackHead h = head();
+            char buf[32];
+            switch (h.kind) {
+            case MpNil: out.append("null", 4); return;
+            case MpBool: if (h.n) out.append("true", 4); else out.append("false", 5); return;
+            case MpUint: case MpInt: {
+                bool neg = h.kind == MpInt && static_cast<int64_t>(h.n) < 0;
+                char ibuf[24];
+                out.append(ibuf, static_cast<size_t>(integer_text(ibuf, neg, neg ? ~h.n : h.n) - ibuf));
+                return;
+            }
+            case MpFloat: out.append(buf, format_num(h.d, buf)); return;
+            case MpStr: out.push_back('\"'); escape_to(out, payload(h.n)); out.push_back('\"'); return;
+            case MpBin: case MpExt: out.push_back('\"'); append_base64url(out, payload(h.n)); out.push_back('\"'); return;
+            case MpArray:
+                items(h);
+                out.push_back('[');
+                for (uint64_t k = 0; k < h.n; ++k) {
+                    if (k) out.push_back(',');
+                    to_json(out);
+                }
+                out.push_back(']');
+                --depth;
+                return;
+            default: {
+                items(h);
+                std::string scratch;
+                out.push_back('{');
+                for (uint64_t k = 0; k < h.n; ++k) {
+                    if (k) out.push_back(',');
+                    out.push_back('\"'); escape_to(out, map_key(scratch)); out.append("\":", 2);
+                    to_json(out);
+                }
+                out.push_back('}');
+                --depth;
+                return;
+            }
+            }
+        }
+    };
+
+    // freeze() layout. A slot's low 3 bits are its kind, the rest an offset (or an inline integer):
+    //   header   u64 magic ("MJB2" plus a byte-order mark), u64 image size, u64 root slot, u64 0
+    //   number   f64
+    //   integer  u64 negative (0 or 1), u64 n: the value is n, or -1 - n if negative (for those
+    //            that don't fit inline)
+    //   string   u64 length, bytes, '\0', padding to 8
+    //   array    u64 n, slot[n]
+    //   object   u64 n, string offset[n] (keys, sorted), slot[n]
+    enum FrozenKind : unsigned { FzNull, FzBool, FzBigInt, FzNum, FzStr, FzArray, FzObject, FzInt };
+    static constexpr uint64_t frozen_magic = 0x0102030432424A4Dull;
+    static constexpr size_t frozen_header = 32;
+    static constexpr int64_t frozen_int_limit = int64_t(1) << 60; // inline integers are 61-bit
+
+    struct Freezer {
+        std::string& out;
+        std::unordered_map<std::string_view, uint64_t> strings; // views into the Json being frozen
+
+        void align() { out.append((8 - out.size() % 8) % 8, '\0'); }
+        uint64_t alloc(size_t n) {
+            align();
+            uint64_t at = out.size();
+            out.append(n, '\0');
+            return at;
+        }
+        void put(uint64_t at, uint64_t v) { std::memcpy(&out[static_cast<size_t>(at)], &v, 8); }
+        uint64_t string(std::string_view s) {
+            auto it = strings.find(s);
+            if (it != strings.end()) return it->second;
+            uint64_t at = alloc(8 + s.size() + 1);
+            put(at, s.size());
+            if (!s.empty()) std::memcpy(&out[static_cast<size_t>(at) + 8], s.data(), s.size());
+            strings.emplace(s, at);
+            return at;
+        }
+        uint64_t slot(const Json& j) {
+            if (j.is_null()) return FzNull;
+            if (j.is_bool()) return (static_cast<uint64_t>(j.as_bool()) << 3) | FzBool;
+            const NumberText* t = j.number_text();
+            bool neg;
+            uint64_t u;
+            if (t && text_integer(t->text, neg, u) && u >= static_cast<uint64_t>(frozen_int_limit)) { // exact, too wide to inline
+                uint64_t at = alloc(16);
+                put(at, neg);
+                put(at + 8, neg ? u - 1 : u);
+                return (at << 3) | FzBigInt;
+            }
+            if (j.is_num()) {
+                double d = j.as_num();
+                if (d == std::floor(d) && d > -9e18 && d < 9e18 && !(d == 0 && std::signbit(d))) {
+                    int64_t v = j.as_int(); // exact for lazy_numbers text
+                    if (v > -frozen_int_limit && v < frozen_int_limit) return (static_cast<uint64_t>(v) << 3) | FzInt;
+                }
+                uint64_t at = alloc(8);
+                std::memcpy(&out[static_cast<size_t>(at)], &d, 8);
+                return (at << 3) | FzNum;
+            }
+            if (j.is_str()) return (string(j.as_str()) << 3) | FzStr;
+            if (j.is_raw()) {
+                Json parsed = parse(j.as_raw());
+                std::unordered_map<std::string_view, uint64_t> keep;
+                keep.swap(strings); // parsed dies below, so its strings can't be shared
+                uint64_t s = slot(parsed);
+                strings.swap(keep);
+                return s;
+            }
+            std::vector<uint64_t> slots;
+            if (j.is_array()) {
+                slots.reserve(j.as_array().size());
+                for (const auto& v : j.as_array()) slots.push_back(slot(v));
+                uint64_t at = alloc(8 + 8 * slots.size());
+                put(at, slots.size());
+                if (!slots.empty()) std::memcpy(&out[static_cast<size_t>(at) + 8], slots.data(), 8 * slots.size());
+                return (at << 3) | FzArray;
+            }
+            const auto& o = j.as_object(); // std::map: already in key order
+            std::vector<uint64_t> keys;
+            keys.reserve(o.size());
+            slots.reserve(o.size());
+            for (const auto& kv : o) {
+                keys.push_back(string(kv.first));
+                slots.push_back(slot(kv.second));
+            }
+            uint64_t at = alloc(8 + 16 * keys.size());
+            put(at, keys.size());
+            if (!keys.empty()) {
+                std::memcpy(&out[static_cast<size_t>(at) + 8], keys.data(), 8 * keys.size());
+                std::memcpy(&out[static_cast<size_t>(at) + 8 + 8 * keys.size()], slots.data(), 8 * slots.size());
+            }
+            return (at << 3) | FzObject;
+        }
+    };
+
+    // Binary formats carry bytes JSON can't; they are turned into base64url text (unpadded).
+    static void append_base64url(std::string& out, std::string_view in) {
+        static const char* digits = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+        size_t k = 0;
+        for (; k + 2 < in.size(); k += 3) {
+            uint32_t v = (static_cast<unsigned char>(in[k]) << 16) | (static_cast<unsigned char>(in[k + 1]) << 8) | static_cast<unsigned char>(in[k + 2]);
+            for (int s = 18; s >= 0; s -= 6) out.push_back(digits[(v >> s) & 63]);
+        }
+        if (k < in.size()) {
+            uint32_t v = static_cast<unsigned char>(in[k]) << 16;
+            if (k + 1 < in.size()) v |= static_cast<unsigned char>(in[k + 1]) << 8;
+            for (int s = 18; s >= (k + 1 < in.size() ? 6 : 12); s -= 6) out.push_back(digits[(v >> s) & 63]);
+        }
+    }
+    static std::string base64url(std::string_view in) {
+        std::string out;
+        out.reserve((in.size() + 2) / 3 * 4);
+        append_base64url(out, in);
+        return out;
+    }
+    // Integer decoded from a binary format, CBOR-style: the value is n, or -1 - n if negative.
+    // Past 2^53 it is kept as exact number text rather than rounded to a double.
+    static Json exact_integer(bool negative, uint64_t n) {
+        if (n < (1ull << 53)) return Json(negative ? -1.0 - static_cast<double>(n) : static_cast<double>(n));
+        char buf[24];
+        return Json(NumberText{ std::string(buf, integer_text(buf, negative, n)) });
+    }
+    static char* integer_text(char (&buf)[24], bool negative, uint64_t n) {
+        char* q = buf;
+        if (negative) *q++ = '-';
+        if (negative && n == UINT64_MAX) { std::memcpy(q, "18446744073709551616", 20); return q + 20; }
+        return std::to_chars(q, buf + sizeof(buf), negative ? n + 1 : n).ptr;
+    }
+
+    // Backs from_cbor(). Nesting is capped so hostile input can't exhaust the stack.
+    struct CborReader {
+        const unsigned char* p;
+        const unsigned char* end;
+        size_t depth{ 0 };
+        static constexpr size_t max_depth = 1024;
+
+        void need(uint64_t n) const {
+            if (static_cast<uint64_t>(end - p) < n) throw std::runtime_error("CBOR: truncated input");
+        }
+        uint64_t be(int n) {
+            need(static_cast<uint64_t>(n));
+            uint64_t v = 0;
+            for (int k = 0; k < n; ++k) v = (v << 8) | *p++;
+            return v;
+        }
+        // Argument that follows an initial byte with additional info `info` (< 28).
+        uint64_t arg(unsigned info) {
+            if (info < 24) return info;
+            if (info > 27) throw std::runtime_error("CBOR: bad additional info");
+            return be(1 << (info - 24));
+        }
+        // Appends the bytes of a (possibly chunked) string of the given major type.
+        void string(unsigned major, unsigned info, std::string& out) {
+            if (info != 31) {
+                uint64_t n = arg(info);
+                need(n);
+                out.append(reinterpret_cast<const char*>(p), static_cast<size_t>(n));
+                p += n;
+                return;
+            }
+            while (true) {
+                need(1);
+                unsigned char ib = *p++;
+                if (ib == 0xFF) return;
+                if ((ib >> 5) != major || (ib & 31) == 31) throw std::runtime_error("CBOR: bad string chunk");
+                string(major, ib & 31, out);
+            }
+        }
+        static double half(uint64_t h) {
+            int e = static_cast<int>((h >> 10) & 0x1F);
+            double m = static_cast<double>(h & 0x3FF);
+            double v = e == 0 ? std::ldexp(m, -24) : e != 31 ? std::ldexp(m + 1024, e - 25) : (m == 0 ? INFINITY : NAN);
+            return (h & 0x8000) ? -v : v;
+        }
+        Json value() {
+            need(1);
+            unsigned char ib = *p++;
+            while ((ib >> 5) == 6) { // tag: keep the content; a loop, so runs of tags can't recurse
+                arg(ib & 31);
+                need(1);
+                ib = *p++;
+            }
+            unsigned major = ib >> 5, info = ib & 31;
+            switch (major) {
+            case 0: return exact_integer(false, arg(info));
+            case 1: return exact_integer(true, arg(info));
+            case 2: case 3: {
+                std::string s;
+                string(major, info, s);
+                return major == 3 ? Json(std::move(s)) : Json(base64url(s));
+            }
+            case 4: case 5: {
+                if (++depth > max_depth) throw std::runtime_error("CBOR: nesting too deep");
+                bool indefinite = info == 31;
+                uint64_t n = indefinite ? 0 : arg(info);
+                if (!indefinite) need(n); // every item takes at least one byte
+                Json j = major == 4 ? Json(Array{}) : Json(Object{});
+                if (major == 4) {
+                    Array& a = j.array_mut();
+                    if (!indefinite) a.reserve(static_cast<size_t>(n));
+                    for (uint64_t k = 0; indefinite ? !at_break() : k < n; ++k) a.push_back(value());
+                }
+                else {
+                    Object& o = j.object_mut();
+                    for (uint64_t k = 0; indefinite ? !at_break() : k < n; ++k) {
+                        Json key = value();
+                        std::string ks = key.is_str() ? std::move(key.as_str()) : key.dump();
+                        o.emplace(std::move(ks), value());
+                    }
+                }
+                --depth;
+                return j;
+            }
+            default:
+                switch (info) {
+                case 20: return Json(false);
+                case 21: return Json(true);
+                case 25: return Json(half(be(2)));
+                case 26: {
+                    uint32_t bits = static_cast<uint32_t>(be(4));
+                    float f;
+                    std::memcpy(&f, &bits, 4);
+                    return Json(static_cast<double>(f));
+                }
+                case 27: {
+                    uint64_t bits = be(8);
+                    double d;
+                    std::memcpy(&d, &bits, 8);
+                    return Json(d);
+                }
+                case 24: be(1); return Json(nullptr); // other simple values
+                case 28: case 29: case 30: case 31: throw std::runtime_error("CBOR: unexpected break or reserved value");
+                default: return Json(nullptr); // null, undefined, unassigned simple values
+                }
+            }
+        }
+        // Consumes the 0xFF that ends an indefinite-length container.
+        bool at_break() {
+            need(1);
+            if (*p != 0xFF) return false;
+            ++p;
+            return true;
+        }
+    };
+
+    // Kind of value a first byte starts; the parser dispatches on it with one table load.
+    enum Token : unsigned char { TokBad, TokNull, TokTrue, TokFalse, TokStr, TokNum, TokObj, TokArr };
+    // Byte classes per JSON's grammar. Table-driven rather than <cctype>, which follows the C
+    // locale and counts \v and \f as whitespace.
+    enum CharClass : unsigned char { ChWs = 1, ChDigit = 2, ChHex = 4, ChStruct = 8 };
+    struct CharTable {
+        unsigned char token[256]{};
+        unsigned char cls[256]{};
+        constexpr CharTable() {
+            token[static_cast<unsigned char>('n')] = TokNull;
+            token[static_cast<unsigned char>('t')] = TokTrue;
+            token[static_cast<unsigned char>('f')] = TokFalse;
+            token[static_cast<unsigned char>('"')] = TokStr;
+            token[static_cast<unsigned char>('-')] = TokNum;
+            token[static_cast<unsigned char>('{')] = TokObj;
+            token[static_cast<unsigned char>('[')] = TokArr;
+            for (int c = '0'; c <= '9'; ++c) { token[c] = TokNum; cls[c] = ChDigit | ChHex; }
+            for (int c = 'a'; c <= 'f'; ++c) cls[c] = ChHex;
+            for (int c = 'A'; c <= 'F'; ++c) cls[c] = ChHex;
+            for (char c : { ' ', '\t', '\n', '\r' }) cls[static_cast<unsigned char>(c)] = ChWs;
+            for (char c : { '{', '}', '[', ']', ':', ',' }) cls[static_cast<unsigned char>(c)] = ChStruct;
+        }
+    };
+    static const CharTable& char_table() {
+        static constexpr CharTable table;
+        return table;
+    }
+    static unsigned char token_of(char c) { return char_table().token[static_cast<unsigned char>(c)]; }
+    static bool is_ws(char c) { return char_table().cls[static_cast<unsigned char>(c)] & ChWs; }
+    static bool is_digit(char c) { return char_table().cls[static_cast<unsigned char>(c)] & ChDigit; }
+    static bool is_hex(char c) { return char_table().cls[static_cast<unsigned char>(c)] & ChHex; }
+    // Ends an unquoted scalar: whitespace or one of {}[]:,
+    static bool ends_scalar(char c) { return char_table().cls[static_cast<unsigned char>(c)] & (ChWs | ChStruct); }
+
+    // Kinds of the open containers in a bracket-matching skip, one bit per level ('[' = 1), so
+    // `{]` is caught without allocating. Deeper nesting than max_depth is rejected.
+    struct BracketStack {
+        static constexpr size_t max_depth = 1024;
+        uint64_t bits[max_depth / 64]{};
+        size_t depth{ 0 };
+        void push(char open) {
+            if (depth == max_depth) throw std::runtime_error("JSON: nesting too deep");
+            uint64_t m = uint64_t(1) << (depth % 64);
+            if (open == '[') bits[depth / 64] |= m;
+            else bits[depth / 64] &= ~m;
+            ++depth;
+        }
+        // Closes the innermost container; throws if close doesn't match how it was opened.
+        void pop(char close) {
+            --depth;
+            bool array = (bits[depth / 64] >> (depth % 64)) & 1;
+            if (array != (close == ']')) throw std::runtime_error("JSON: mismatched bracket");
+        }
+    };
+
+    // Elements parsed ahead on a worker thread: the text between the commas at `at` and `end`.
+    // ok only if that text was exactly a run of elements that parsed without error.
+    struct Run {
+        size_t at, end;
+        bool ok{ false };
+        Json::Array items;
+    };
+
+    //Minimal recursive-descent parser
+    // Padded: s is followed by PaddedString::padding zero bytes, so peek()/get() read without
+    // checking for the end (the '\0' sentinel stops every scan) and strings are scanned 16 bytes
+    // at a time right up to the end. Escape handling may step a few bytes into the padding
+    // before the next eof() check notices.
+    template <bool Padded>
+    struct BasicParser {
+        std::string_view s;
+        size_t i{ 0 };
+        bool lazy_numbers{ false };
+        std::string scratch; // decoded escaped keys (key_view)
+        static constexpr size_t npos = static_cast<size_t>(-1);
+        size_t wanted{ npos }; // selected subtrees left before stopping early (extract); npos = read everything
+        std::vector<const PathMask*> found; // selected subtrees already built, so a repeated key counts once
+        std::vector<Run>* runs{ nullptr }; // parse_parallel: elements to splice in, sorted by position
+        size_t next_run{ 0 };
+        ScanFn scan{ kernel().scan_string };
+        SkipFn skip{ kernel().skip_ws };
+        BasicParser(std::string_view sv) : s(sv) {}
+
+        bool eof() const { return i >= s.size(); }
+        char peek() const {
+            if constexpr (Padded) return s.data()[i];
+            else return eof() ? '\0' : s[i];
+        }
+        char get() {
+            if constexpr (Padded) return s.data()[i++];
+            else return eof() ? '\0' : s[i++];
+        }
+        // A single whitespace byte (", ", ": ") is the common case and stays scalar; longer runs,
+        // like the indentation of pretty-printed input, go to the vector kernel.
+        void skip_ws() {
+            if (!is_ws(peek())) return;
+            ++i;
+            if (!is_ws(peek())) return;
+            const char* end = s.data() + s.size() + (Padded ? PaddedString::padding : 0);
+            i = static_cast<size_t>(skip(s.data() + i, end) - s.data());
+        }
+        // End of the plain (quote/backslash/control-free) run starting at i.
+        size_t plain_run() const {
+            const char* end = s.data() + s.size() + (Padded ? PaddedString::padding : 0);
+            return static_cast<size_t>(scan(s.data() + i, end, false) - s.data());
+        }
+        void expect(char c) {
+            if (get() != c) throw std::runtime_error(std::string("JSON: expected '") + c + "'");
+        }
+
+        // raw: subtrees to capture as Raw. only: projection; subtrees outside it are validated
+        // with skip_value() and dropped (array elements become null to keep indices stable).
+        Json parse_value(const PathMask* raw = nullptr, const PathMask* only = nullptr) {
+            skip_ws();
+            if (only && only->leaf()) {
+                Json v = parse_value(raw, nullptr);
+                if (wanted != npos) found_leaf(only);
+                return v;
+            }
+            if (raw && raw->leaf()) {
+                size_t start = i;
+                skip_value(); // dump() re-emits the text as is, so it must be valid JSON
+                return Json::raw(std::string(s.substr(start, i - start)));
+            }
+            switch (token_of(peek())) {
+            case TokNull: return parse_null();
+            case TokTrue: case TokFalse: return parse_bool();
+            case TokStr: return parse_string();
+            case TokNum: return parse_number();
+            case TokObj: return parse_object(raw, only);
+            case TokArr: return parse_array(raw, only);
+            default: throw std::runtime_error("JSON: unexpected token");
+            }
+        }
+
+        void found_leaf(const PathMask* leaf) {
+            for (const PathMask* f : found) if (f == leaf) return;
+            found.push_back(leaf);
+            --wanted;
+        }
+
+        // Checks one value against the same grammar as parse_value and steps over it without
+        // building or allocating anything.
+        void skip_value() {
+            skip_ws();
+            switch (token_of(peek())) {
+            case TokNull: parse_null(); return;
+            case TokTrue: case TokFalse: parse_bool(); return;
+            case TokNum: scan_number(); return;
+            case TokStr: skip_string_checked(); return;
+            case TokArr:
+                ++i; skip_ws();
+                if (peek() == ']') { ++i; return; }
+                while (true) {
+                    skip_value();
+                    skip_ws();
+                    char d = get();
+                    if (d == ']') return;
+                    if (d != ',') throw std::runtime_error("JSON: expected ',' or ']'");
+                }
+            case TokObj:
+                ++i; skip_ws();
+                if (peek() == '}') { ++i; return; }
+                while (true) {
+                    skip_ws();
+                    if (peek() != '"') throw std::runtime_error("JSON: expected string key");
+                    skip_string_checked();
+                    skip_ws(); expect(':');
+                    skip_value();
+                    skip_ws();
+                    char d = get();
+                    if (d == '}') return;
+                    if (d != ',') throw std::runtime_error("JSON: expected ',' or '}'");
+                }
+            default: throw std::runtime_error("JSON: unexpected token");
+            }
+        }
+        void skip_string_checked() {
+            ++i; // opening quote
+            while (!eof()) {
+                i = plain_run();
+                if (eof()) break;
+                char c = s[i++];
+                if (c == '"') return;
+                if (c != '\\') continue;
+                switch (get()) {
+                case '"': case '\\': case '/': case 'b': case 'f': case 'n': case 'r': case 't': break;
+                case 'u':
+                    if (s.size() - i < 4) throw std::runtime_error("JSON: unterminated string");
+                    i += 4;
+                    break;
+                default: throw std::runtime_error("JSON: bad escape");
+                }
+            }
+            throw std::runtime_error("JSON: unterminated string");
+        }
+        // Reads a quoted key; the view points into the input unless the key has escapes.
+        std::string_view key_view() {
+            size_t start = i + 1;
+            skip_string_checked();
+            std::string_view k = s.substr(start, i - 1 - start);
+            if (k.find('\\') == std::string_view::npos) return k;
+            i = start - 1;
+            scratch = parse_string().as_str();
+            return scratch;
+        }
+
+        // Skips one value without building it: strings are scanned to their closing quote and
+        // containers by bracket matching. Only nesting is checked (each ']' or '}' must close
+        // the kind of container that is open), not the grammar inside.
+        void skip_raw() {
+            char c = peek();
+            if (c == '"') { skip_string(); return; }
+            if (c == '{' || c == '[') {
+                BracketStack open;
+                while (!eof()) {
+                    char ch = s[i];
+                    if (ch == '"') { skip_string(); continue; }
+                    ++i;
+                    if (ch == '{' || ch == '[') open.push(ch);
+                    else if (ch == '}' || ch == ']') {
+                        open.pop(ch);
+                        if (open.depth == 0) return;
+                    }
+                }
+                throw std::runtime_error("JSON: unterminated container");
+            }
+            size_t start = i;
+            while (!eof() && !ends_scalar(s[i])) ++i;
+            if (i == start) throw std::runtime_error("JSON: unexpected token");
+        }
+        void skip_string() {
+            ++i; // opening quote
+            while (!eof()) {
+                i = plain_run();
+                if (eof()) break;
+                char c = s[i++];
+                if (c == '"') return;
+                if (c == '\\') ++i;
+            }
+            throw std::runtime_error("JSON: unterminated string");
+        }
+
+        // Literals are checked with one 4-byte compare each ("alse" after the 'f' for false).
+        bool word_at(size_t at, const char* w) const {
+            if (!Padded && (at > s.size() || s.size() - at < 4)) return false;
+            uint32_t a, b;
+            std::memcpy(&a, s.data() + at, 4);
+            std::memcpy(&b, w, 4);
+            return a == b;
+        }
+        Json parse_null() {
+            if (!word_at(i, "null")) throw std::runtime_error("JSON: unexpected token");
+            i += 4;
+            return Json(nullptr);
+        }
+        Json parse_bool() {
+            bool f = peek() == 'f';
+            if (!word_at(i + f, f ? "alse" : "true")) throw std::runtime_error("JSON: unexpected token");
+            i += 4 + f;
+            return Json(!f);
+        }
+        Json parse_number() {
+            size_t start = scan_number();
+            if (lazy_numbers) return Json(NumberText{ std::string(s.substr(start, i - start)) });
+            return Json(to_double(s.substr(start, i - start)));
+        }
+        // Steps over a number, checking its syntax; returns where it started.
+        size_t scan_number() {
+            size_t start = i;
+            if (peek() == '-') ++i;
+            if (peek() == '0') { ++i; }
+            else {
+                if (!is_digit(peek())) throw std::runtime_error("JSON: bad number");
+                while (is_digit(peek())) ++i;
+            }
+            if (peek() == '.') { ++i; if (!is_digit(peek())) throw std::runtime_error("JSON: bad number"); while (is_digit(peek())) ++i; }
+            if (peek() == 'e' || peek() == 'E') { ++i; if (peek() == '+' || peek() == '-') ++i; if (!is_digit(peek())) throw std::runtime_error("JSON: bad number"); while (is_digit(peek())) ++i; }
+            return start;
+        }
+        Json parse_string() {
+            expect('"');
+            std::string out;
+            while (!eof()) {
+                size_t run = plain_run();
+                out.append(s.data() + i, run - i);
+                i = run;
+                if (eof()) break;
+                char c = get();
+                if (c == '"') break;
+                if (c == '\\') {
+                    char e = get();
+                    switch (e) {
+                    case '"':  out += '"';  break;
+                    case '\\': out += '\\'; break;
+                    case '/':  out += '/';  break;
+                    case 'b':  out += '\b'; break;
+                    case 'f':  out += '\f'; break;
                     case 'n':  out += '\n'; break;
                     case 'r':  out += '\r'; break;
                     case 't':  out += '\t'; break;
@@ -251,14 +2075,18 @@ private:
             }
             return Json(std::move(out));
         }
-        Json parse_array() {
+        Json parse_array(const PathMask* raw = nullptr, const PathMask* only = nullptr) {
             expect('[');
             Json::Array arr;
             skip_ws();
             if (peek() == ']') { get(); return Json(arr); }
             while (true) {
-                arr.push_back(parse_value());
+                const PathMask* sel = only ? only->child(arr.size()) : nullptr;
+                if (only && !sel) { skip_value(); arr.emplace_back(); }
+                else arr.push_back(parse_value(raw ? raw->child(arr.size()) : nullptr, sel));
+                if (wanted == 0) return Json(arr);
                 skip_ws();
+                if (runs) take_runs(arr);
                 char c = get();
                 if (c == ']') break;
                 if (c != ',') throw std::runtime_error("JSON: expected ',' or ']'");
@@ -266,7 +2094,22 @@ private:
             }
             return Json(arr);
         }
-        Json parse_object() {
+        // At a comma in an array: if a worker already parsed the elements that follow it, takes
+        // them and moves on to the comma after them.
+        void take_runs(Json::Array& arr) {
+            std::vector<Run>& r = *runs;
+            while (next_run < r.size() && r[next_run].at < i) ++next_run;
+            if (next_run < r.size() && r[next_run].at == i && r[next_run].ok) {
+                size_t more = r[next_run].items.size();
+                for (size_t k = next_run + 1; k < r.size() && r[k].at == r[k - 1].end && r[k].ok; ++k) more += r[k].items.size();
+                arr.reserve(arr.size() + more);
+            }
+            for (; next_run < r.size() && r[next_run].at == i && r[next_run].ok; ++next_run) {
+                arr.insert(arr.end(), std::make_move_iterator(r[next_run].items.begin()), std::make_move_iterator(r[next_run].items.end()));
+                i = r[next_run].end;
+            }
+        }
+        Json parse_object(const PathMask* raw = nullptr, const PathMask* only = nullptr) {
             expect('{');
             Json::Object obj;
             skip_ws();
@@ -274,10 +2117,20 @@ private:
             while (true) {
                 skip_ws();
                 if (peek() != '"') throw std::runtime_error("JSON: expected string key");
-                std::string key = parse_string().as_str();
+                std::string key;
+                const PathMask* sel = nullptr;
+                if (only) {
+                    std::string_view k = key_view();
+                    if ((sel = only->child(k))) key.assign(k);
+                }
+                else key = parse_string().as_str();
                 skip_ws(); expect(':');
-                Json val = parse_value();
-                obj.emplace(std::move(key), std::move(val));
+                if (only && !sel) skip_value();
+                else {
+                    Json val = parse_value(raw ? raw->child(key) : nullptr, sel);
+                    obj.emplace(std::move(key), std::move(val));
+                }
+                if (wanted == 0) return Json(obj);
                 skip_ws();
                 char c = get();
                 if (c == '}') break;
@@ -287,4 +2140,1310 @@ private:
             return Json(obj);
         }
     };
+    using Parser = BasicParser<false>;
+
+    // parse() with several threads. A quote-aware scan, itself split across the threads, finds
+    // in each chunk of the input the first comma at the depth most chunks bottom out at (the
+    // elements of the big array, typically). Workers parse the text between consecutive such
+    // commas as a run of elements. Then this thread parses the document as usual, and on
+    // reaching one of those commas in an array takes the run's elements and skips the text. A
+    // run that isn't exactly a list of valid elements (it crossed a container boundary, or its
+    // commas were an object's) is just parsed here in line, so nothing depends on guessing right.
+    struct ChunkScan {
+        static constexpr int span = 64; // commas tracked this many levels above/below the chunk start
+        size_t from, to;
+        bool quotes{ false }; // odd number of unescaped quotes
+        bool in_str{ false }; // chunk starts inside a string
+        int delta{ 0 };       // depth change across the chunk
+        size_t first[2 * span + 1], last[2 * span + 1]; // by relative depth; none if no comma
+        static constexpr size_t none = static_cast<size_t>(-1);
+    };
+    static Json parse_parallel(const PaddedString& s, const ParseOptions& opt, size_t threads) {
+        const char* d = s.data();
+        const size_t n = s.size(), chunks = threads * 4; // finer than threads: a run that fails costs less
+        std::vector<ChunkScan> scan(chunks);
+        for (size_t k = 0; k < chunks; ++k) { scan[k].from = n / chunks * k; scan[k].to = k + 1 == chunks ? n : n / chunks * (k + 1); }
+        run_parallel(threads, chunks, [&](size_t k) { scan[k].quotes = quote_parity(d, scan[k].from, scan[k].to); });
+        for (size_t k = 1; k < chunks; ++k) scan[k].in_str = scan[k - 1].in_str != scan[k - 1].quotes;
+        run_parallel(threads, chunks, [&](size_t k) { scan_commas(d, scan[k]); });
+
+        // Split depth: the most common shallowest comma depth over the chunks (ties: shallower).
+        std::vector<int> depth(chunks);
+        std::map<int, size_t> votes;
+        for (size_t k = 0; k < chunks; ++k) {
+            depth[k] = k ? depth[k - 1] + scan[k - 1].delta : 0;
+            for (int r = -ChunkScan::span; r <= ChunkScan::span; ++r) {
+                if (scan[k].first[r + ChunkScan::span] != ChunkScan::none) { ++votes[depth[k] + r]; break; }
+            }
+        }
+        int split = 0;
+        size_t best = 0;
+        for (const auto& v : votes) if (v.first > 0 && v.second > best) { split = v.first; best = v.second; }
+        std::vector<size_t> at;
+        for (size_t k = 0; split > 0 && k < chunks; ++k) {
+            int r = split - depth[k];
+            if (r < -ChunkScan::span || r > ChunkScan::span) continue;
+            if (scan[k].first[r + ChunkScan::span] != ChunkScan::none) at.push_back(scan[k].first[r + ChunkScan::span]);
+            if (k + 1 == chunks && scan[k].last[r + ChunkScan::span] != ChunkScan::none) at.push_back(scan[k].last[r + ChunkScan::span]);
+        }
+        std::vector<Run> runs;
+        for (size_t k = 1; k < at.size(); ++k) if (at[k] > at[k - 1]) runs.push_back(Run{ at[k - 1], at[k], false, {} });
+        run_parallel(threads, runs.size(), [&](size_t k) { parse_run(s, opt, runs[k]); });
+
+        BasicParser<true> p(s.view());
+        p.lazy_numbers = opt.lazy_numbers;
+        if (!runs.empty()) p.runs = &runs;
+        Json j = p.parse_value();
+        p.skip_ws();
+        if (!p.eof()) throw std::runtime_error("JSON: trailing characters");
+        return j;
+    }
+    // Calls f(0..count-1), spread over up to `threads` threads including this one. Indices are
+    // handed out one at a time, so if some threads can't be started the others do their share.
+    template <class F>
+    static void run_parallel(size_t threads, size_t count, F f) {
+        std::atomic<size_t> next{ 0 };
+        auto work = [&] { for (size_t k; (k = next.fetch_add(1, std::memory_order_relaxed)) < count;) f(k); };
+#if MINIJSON_THREADS
+        if (threads > count) threads = count;
+        std::vector<std::thread> pool;
+        struct JoinAll {
+            std::vector<std::thread>& pool;
+            ~JoinAll() { for (auto& th : pool) th.join(); }
+        } join_all{ pool };
+        try {
+            pool.reserve(threads);
+            for (size_t t = 1; t < threads; ++t) pool.emplace_back(work);
+        }
+        catch (const std::exception&) {} // out of threads or memory: carry on with those running
+#else
+        (void)threads;
+#endif
+        work();
+    }
+    // Whether the byte at `at` follows an odd run of backslashes (and so is escaped in a string).
+    static bool escaped_at(const char* d, size_t at) {
+        size_t k = at;
+        while (k > 0 && d[k - 1] == '\\') --k;
+        return (at - k) & 1;
+    }
+    // Counts quotes 8 bytes at a time, going byte by byte only around backslashes.
+    static bool quote_parity(const char* d, size_t from, size_t to) {
+        const char* p = d + from + escaped_at(d, from);
+        const char* end = d + to;
+        bool odd = false;
+        while (p < end) {
+            if (end - p >= 8) {
+                uint64_t w;
+                std::memcpy(&w, p, 8);
+                if (!bytes_equal(w, '\\')) {
+                    uint64_t q = bytes_equal(w, '"') >> 7; // one bit per quote, at the bottom of its byte
+                    odd ^= ((q * 0x0101010101010101ull) >> 56) & 1;
+                    p += 8;
+                    continue;
+                }
+            }
+            if (*p == '"') odd = !odd;
+            p += *p == '\\' ? 2 : 1;
+        }
+        return odd;
+    }
+    // High bit set in each byte of w equal to c, and nowhere else.
+    static uint64_t bytes_equal(uint64_t w, char c) {
+        const uint64_t low7 = 0x7F7F7F7F7F7F7F7Full;
+        uint64_t x = w ^ (0x0101010101010101ull * static_cast<unsigned char>(c));
+        return ~(((x & low7) + low7) | x | low7);
+    }
+    static void scan_commas(const char* d, ChunkScan& c) {
+        for (size_t r = 0; r <= 2 * ChunkScan::span; ++r) c.first[r] = c.last[r] = ChunkScan::none;
+        ScanFn scan = kernel().scan_string;
+        const char* p = d + c.from;
+        const char* end = d + c.to;
+        bool in_str = c.in_str;
+        if (in_str && escaped_at(d, c.from)) ++p;
+        int r = 0;
+        while (p < end) {
+            if (in_str) {
+                p = scan(p, end, false);
+                if (p >= end) break;
+                if (*p == '"') in_str = false;
+                p += *p == '\\' ? 2 : 1;
+                continue;
+            }
+            switch (*p++) {
+            case '"': in_str = true; break;
+            case '{': case '[': ++r; break;
+            case '}': case ']': --r; break;
+            case ',':
+                if (r >= -ChunkScan::span && r <= ChunkScan::span) {
+                    size_t pos = static_cast<size_t>(p - 1 - d);
+                    if (c.first[r + ChunkScan::span] == ChunkScan::none) c.first[r + ChunkScan::span] = pos;
+                    c.last[r + ChunkScan::span] = pos;
+                }
+                break;
+            default: break;
+            }
+        }
+        c.delta = r;
+    }
+    // The padded parser reads past the run's end only into the rest of the document (or its
+    // padding), and a run that does is rejected, so it sees exactly what parse() would.
+    static void parse_run(const PaddedString& s, const ParseOptions& opt, Run& r) {
+        BasicParser<true> p(std::string_view(s.data() + r.at + 1, r.end - r.at - 1));
+        p.lazy_numbers = opt.lazy_numbers;
+        try {
+            while (true) {
+                r.items.push_back(p.parse_value());
+                p.skip_ws();
+                if (p.i >= p.s.size()) { r.ok = p.i == p.s.size(); break; }
+                if (p.get() != ',') break;
+            }
+        }
+        catch (const std::exception&) {}
+        if (!r.ok) Json::Array().swap(r.items);
+    }
+
+    // Read buffer over a pull source for the stream readers. Values are framed with the
+    // quote-aware bracket scan of skip_raw, refilling (and if need be growing) the buffer, and
+    // then parsed in place. buf holds [0, len) followed by at least PaddedString::padding spare
+    // bytes; bytes before mark are dropped on the next refill.
+    struct StreamBuffer {
+        std::function<size_t(char*, size_t)> read; // fills up to n bytes; 0 at end of input
+        size_t chunk;
+        std::string buf;
+        size_t len{ 0 }, pos{ 0 }, mark{ 0 };
+        uint64_t base{ 0 }; // stream offset of buf[0]
+        bool eof{ false };
+        bool records{ false }; // RFC 7464 input: an RS byte cuts short the value being framed
+        ScanFn scan{ kernel().scan_string };
+        SkipFn skip{ kernel().skip_ws };
+
+        StreamBuffer(std::function<size_t(char*, size_t)> r, size_t chunk_size)
+            : read(std::move(r)), chunk(chunk_size ? chunk_size : 1), buf(chunk + PaddedString::padding, '\0') {}
+
+        static std::function<size_t(char*, size_t)> reader(std::istream& in) {
+            return [&in](char* dst, size_t n) {
+                in.read(dst, static_cast<std::streamsize>(n));
+                return static_cast<size_t>(in.gcount());
+            };
+        }
+        static std::function<size_t(char*, size_t)> reader(std::string_view s) {
+            return [s](char* dst, size_t n) mutable {
+                n = n < s.size() ? n : s.size();
+                if (n) std::memcpy(dst, s.data(), n);
+                s.remove_prefix(n);
+                return n;
+            };
+        }
+
+        bool fill() {
+            if (eof) return false;
+            if (mark > 0) {
+                std::memmove(&buf[0], &buf[mark], len - mark);
+                base += mark; len -= mark; pos -= mark; mark = 0;
+            }
+            if (buf.size() - PaddedString::padding - len < chunk / 4 + 1) buf.resize(2 * (buf.size() - PaddedString::padding) + PaddedString::padding);
+            size_t n = read(&buf[len], buf.size() - PaddedString::padding - len);
+            if (n == 0) { eof = true; return false; }
+            len += n;
+            return true;
+        }
+        // Skips whitespace, dropping everything before it; false at end of input.
+        bool skip_ws() {
+            while (true) {
+                pos = static_cast<size_t>(skip(buf.data() + pos, buf.data() + len) - buf.data());
+                if (pos < len) return true;
+                mark = pos;
+                if (!fill()) return false;
+            }
+        }
+        char peek() {
+            if (pos == len && !fill()) throw std::runtime_error("JSON: unexpected end of input");
+            return buf[pos];
+        }
+        void expect(char c) {
+            if (peek() != c) throw std::runtime_error(std::string("JSON: expected '") + c + "'");
+            ++pos;
+        }
+        // Steps pos over the value starting there. With keep, buf[mark, pos) is then that value;
+        // without, it is dropped as it goes, so skipping a huge value takes no extra memory.
+        void frame(bool keep) {
+            mark = pos;
+            char c = peek();
+            if (c != '"' && c != '{' && c != '[') {
+                size_t n = 0;
+                do {
+                    while (pos < len && !ends_scalar(buf[pos]) && buf[pos] != '"' && buf[pos] != '\x1E') { ++pos; ++n; }
+                    if (!keep) mark = pos;
+                } while (pos == len && fill());
+                if (n == 0) throw std::runtime_error("JSON: unexpected token");
+                return;
+            }
+            BracketStack open;
+            bool in_str = false;
+            while (true) {
+                while (pos < len) {
+                    if (in_str) {
+                        pos = static_cast<size_t>(scan(buf.data() + pos, buf.data() + len, false) - buf.data());
+                        if (pos == len) break;
+                        char ch = buf[pos];
+                        if (ch == '\x1E' && records) throw std::runtime_error("JSON: truncated record");
+                        if (ch == '\\') {
+                            if (pos + 1 == len) break; // escaped byte not read yet
+                            pos += 2;
+                            continue;
+                        }
+                        ++pos;
+                        if (ch == '"') { in_str = false; if (open.depth == 0) return; }
+                        continue;
+                    }
+                    char ch = buf[pos];
+                    if (ch == '\x1E' && records) throw std::runtime_error("JSON: truncated record");
+                    ++pos;
+                    if (ch == '"') in_str = true;
+                    else if (ch == '{' || ch == '[') open.push(ch);
+                    else if (ch == '}' || ch == ']') {
+                        open.pop(ch);
+                        if (open.depth == 0) return;
+                    }
+                }
+                if (!keep) mark = pos;
+                if (!fill()) throw std::runtime_error(in_str ? "JSON: unterminated string" : "JSON: unterminated container");
+            }
+        }
+        // Parses the value frame(true) just found. The padding bytes after it are zeroed for the
+        // parser and put back afterwards, so nothing is copied.
+        Json parse(const ParseOptions* opt) {
+            struct Restore {
+                char* at;
+                char saved[PaddedString::padding];
+                ~Restore() { std::memcpy(at, saved, sizeof(saved)); }
+            } r{ &buf[pos], {} };
+            std::memcpy(r.saved, r.at, sizeof(r.saved));
+            std::memset(r.at, 0, sizeof(r.saved));
+            BasicParser<true> p(std::string_view(buf.data() + mark, pos - mark));
+            Json j;
+            if (opt) {
+                p.lazy_numbers = opt->lazy_numbers;
+                j = p.parse_value(opt->raw.empty() ? nullptr : &opt->raw, opt->only.empty() ? nullptr : &opt->only);
+            }
+            else j = p.parse_value();
+            if (!p.eof()) throw std::runtime_error("JSON: unexpected token");
+            return j;
+        }
+    };
+};
+
+// On-demand reader over a JSON buffer: nothing is built up front. Each lookup scans forward from
+// the current value, skipping unrequested members with the bracket-depth skip, and only the
+// values actually read are parsed (and so validated). Object lookups resume after the last member
+// found and wrap around, so reading fields in document order is a single pass. The buffer must
+// outlive every Lazy taken from it; a Lazy caches that position, so don't share one across threads.
+//   Json::Lazy doc(body);
+//   std::string type = doc["type"].as_str();
+//   double ts = doc["meta"]["ts"].as_num();
+class Json::Lazy {
+public:
+    explicit Lazy(std::string_view doc) : s_(doc) {
+        Parser p(s_);
+        p.skip_ws();
+        if (p.eof()) throw std::runtime_error("JSON: unexpected token");
+        pos_ = hint_ = p.i;
+    }
+
+    bool is_null()   const { return c() == 'n'; }
+    bool is_bool()   const { return c() == 't' || c() == 'f'; }
+    bool is_num()    const { return c() == '-' || (c() >= '0' && c() <= '9'); }
+    bool is_str()    const { return c() == '"'; }
+    bool is_array()  const { return c() == '['; }
+    bool is_object() const { return c() == '{'; }
+
+    bool as_bool() const { return parser().parse_bool().as_bool(); }
+    double as_num() const { return parser().parse_number().as_num(); }
+    int64_t as_int() const {
+        Parser p = parser();
+        p.lazy_numbers = true;
+        return p.parse_number().as_int();
+    }
+    std::string as_str() const { return parser().parse_string().as_str(); }
+    // Source text of this value, e.g. to forward it as Json::raw().
+    std::string_view raw() const {
+        Parser p = parser();
+        p.skip_raw();
+        return s_.substr(pos_, p.i - pos_);
+    }
+    // Builds this value (and everything under it) as a regular Json.
+    Json get() const { return parser().parse_value(); }
+
+    std::optional<Lazy> find(std::string_view key) const {
+        if (!is_object()) throw std::runtime_error("JSON: expected '{'");
+        // pass 0 scans from the hint to the end, pass 1 from the start up to the hint
+        for (int pass = 0; pass < 2; ++pass) {
+            Parser p(s_);
+            p.i = pass == 0 ? hint_ : pos_;
+            if (p.i == pos_) { p.expect('{'); p.skip_ws(); if (p.peek() == '}') return std::nullopt; }
+            while (pass == 0 || p.i < hint_) {
+                p.skip_ws();
+                bool match = key_equals(p, key);
+                p.skip_ws(); p.expect(':'); p.skip_ws();
+                size_t at = p.i;
+                p.skip_raw();
+                p.skip_ws();
+                char c = p.get();
+                if (c != ',' && c != '}') throw std::runtime_error("JSON: expected ',' or '}'");
+                if (match) {
+                    hint_ = c == ',' ? p.i : pos_;
+                    return Lazy(s_, at);
+                }
+                if (c == '}') break;
+            }
+            if (hint_ == pos_) break; // the first pass already covered the whole object
+        }
+        return std::nullopt;
+    }
+    Lazy at(std::string_view key) const {
+        auto v = find(key);
+        if (!v) throw std::out_of_range("JSON: key not found");
+        return *v;
+    }
+    Lazy operator[](std::string_view key) const { return at(key); }
+
+    Lazy at(size_t index) const {
+        Lazy out(s_, pos_);
+        size_t n = 0;
+        for_each([&](const Lazy& v) { if (n++ == index) { out = v; return false; } return true; });
+        if (n <= index) throw std::out_of_range("JSON: index out of range");
+        return out;
+    }
+    Lazy operator[](size_t index) const { return at(index); }
+
+    // Visits array elements in order; f(const Lazy&) returns false to stop early.
+    template <class F>
+    void for_each(F f) const {
+        Parser p = parser();
+        p.expect('[');
+        p.skip_ws();
+        if (p.peek() == ']') return;
+        while (true) {
+            p.skip_ws();
+            if (!f(Lazy(s_, p.i))) return;
+            p.skip_raw();
+            p.skip_ws();
+            char c = p.get();
+            if (c == ']') return;
+            if (c != ',') throw std::runtime_error("JSON: expected ',' or ']'");
+        }
+    }
+    size_t size() const {
+        if (is_array()) { size_t n = 0; for_each([&](const Lazy&) { ++n; return true; }); return n; }
+        Parser p = parser();
+        p.expect('{');
+        p.skip_ws();
+        if (p.peek() == '}') return 0;
+        size_t n = 0;
+        while (true) {
+            p.skip_ws(); p.skip_string(); p.skip_ws(); p.expect(':'); p.skip_ws(); p.skip_raw(); p.skip_ws();
+            ++n;
+            char c = p.get();
+            if (c == '}') return n;
+            if (c != ',') throw std::runtime_error("JSON: expected ',' or '}'");
+        }
+    }
+
+private:
+    std::string_view s_;
+    size_t pos_{ 0 };
+    mutable size_t hint_{ 0 }; // where the next object lookup starts
+
+    Lazy(std::string_view s, size_t pos) : s_(s), pos_(pos), hint_(pos) {}
+
+    char c() const { return s_[pos_]; }
+    Parser parser() const { Parser p(s_); p.i = pos_; return p; }
+
+    // Consumes a key and compares it; escaped keys are decoded first.
+    static bool key_equals(Parser& p, std::string_view key) {
+        if (p.peek() != '"') throw std::runtime_error("JSON: expected string key");
+        size_t start = p.i + 1;
+        p.skip_string();
+        std::string_view k = p.s.substr(start, p.i - 1 - start);
+        if (k.find('\\') == std::string_view::npos) return k == key;
+        Parser q(p.s);
+        q.i = start - 1;
+        return q.parse_string().as_str() == key;
+    }
+};
+
+// Read-only view over a MessagePack buffer, in the manner of Json::Lazy: nothing is decoded up
+// front, lookups step over unrequested items by their encoded lengths, and str and bin payloads
+// come back as views into the buffer, so reading a field copies nothing. The buffer must outlive
+// every view taken from it. dump()/dump_to() transcode straight to compact JSON text.
+//   Json::MsgPackView doc(packet);
+//   std::string_view host = doc["host"].as_str();
+class Json::MsgPackView {
+public:
+    explicit MsgPackView(std::string_view data) : s_(data) {
+        if (data.empty()) throw std::runtime_error("MsgPack: truncated input");
+    }
+
+    bool is_null()   const { return kind() == MpNil; }
+    bool is_bool()   const { return kind() == MpBool; }
+    bool is_num()    const { MsgPackKind k = kind(); return k == MpUint || k == MpInt || k == MpFloat; }
+    bool is_str()    const { return kind() == MpStr; }
+    bool is_bin()    const { return kind() == MpBin; }
+    bool is_array()  const { return kind() == MpArray; }
+    bool is_object() const { return kind() == MpMap; }
+
+    bool as_bool() const { return head(MpBool, "bool").n != 0; }
+    double as_num() const {
+        MsgPackHead h = reader().head();
+        if (h.kind == MpUint) return static_cast<double>(h.n);
+        if (h.kind == MpInt) return static_cast<double>(static_cast<int64_t>(h.n));
+        if (h.kind == MpFloat) return h.d;
+        throw std::runtime_error("MsgPack: expected number");
+    }
+    // Exact for every integer encoding (uint64 values past INT64_MAX throw, as do floats out of range).
+    int64_t as_int() const {
+        MsgPackHead h = reader().head();
+        if (h.kind == MpUint && h.n > static_cast<uint64_t>(INT64_MAX)) throw std::runtime_error("MsgPack: number out of int64 range");
+        if (h.kind == MpUint || h.kind == MpInt) return static_cast<int64_t>(h.n);
+        if (h.kind == MpFloat) return to_int64(h.d, "MsgPack");
+        throw std::runtime_error("MsgPack: expected number");
+    }
+    std::string_view as_str() const { return payload(MpStr, "str"); }
+    std::string_view as_bin() const { return payload(MpBin, "bin"); }
+    // Builds this item (and everything under it) as a regular Json.
+    Json get() const { return reader().value(); }
+    std::string dump() const {
+        std::string out;
+        dump_to(out);
+        return out;
+    }
+    void dump_to(std::string& out) const { reader().to_json(out); }
+
+    std::optional<MsgPackView> find(std::string_view key) const {
+        MsgPackReader r = reader();
+        MsgPackHead h = r.head();
+        if (h.kind != MpMap) throw std::runtime_error("MsgPack: expected map");
+        std::string scratch;
+        for (uint64_t k = 0; k < h.n; ++k) {
+            bool match = r.map_key(scratch) == key;
+            if (match) return MsgPackView(s_, offset(r));
+            r.skip();
+        }
+        return std::nullopt;
+    }
+    MsgPackView at(std::string_view key) const {
+        auto v = find(key);
+        if (!v) throw std::out_of_range("MsgPack: key not found");
+        return *v;
+    }
+    MsgPackView operator[](std::string_view key) const { return at(key); }
+
+    MsgPackView at(size_t index) const {
+        MsgPackReader r = reader();
+        MsgPackHead h = r.head();
+        if (h.kind != MpArray) throw std::runtime_error("MsgPack: expected array");
+        if (index >= h.n) throw std::out_of_range("MsgPack: index out of range");
+        for (size_t k = 0; k < index; ++k) r.skip();
+        return MsgPackView(s_, offset(r));
+    }
+    MsgPackView operator[](size_t index) const { return at(index); }
+
+    // Visits array items in order; f(const MsgPackView&) returns false to stop early.
+    template <class F>
+    void for_each(F f) const {
+        MsgPackReader r = reader();
+        MsgPackHead h = r.head();
+        if (h.kind != MpArray) throw std::runtime_error("MsgPack: expected array");
+        for (uint64_t k = 0; k < h.n; ++k) {
+            if (!f(MsgPackView(s_, offset(r)))) return;
+            r.skip();
+        }
+    }
+    // Item count of an array or map, read from its header.
+    size_t size() const {
+        MsgPackHead h = reader().head();
+        if (h.kind != MpArray && h.kind != MpMap) throw std::runtime_error("MsgPack: expected array or map");
+        return static_cast<size_t>(h.n);
+    }
+
+private:
+    std::string_view s_;
+    size_t pos_{ 0 };
+
+    MsgPackView(std::string_view s, size_t pos) : s_(s), pos_(pos) {}
+
+    MsgPackReader reader() const {
+        const unsigned char* base = reinterpret_cast<const unsigned char*>(s_.data());
+        return MsgPackReader{ base + pos_, base + s_.size() };
+    }
+    size_t offset(const MsgPackReader& r) const {
+        return static_cast<size_t>(r.p - reinterpret_cast<const unsigned char*>(s_.data()));
+    }
+    MsgPackKind kind() const { return reader().head().kind; }
+    MsgPackHead head(MsgPackKind want, const char* name) const {
+        MsgPackHead h = reader().head();
+        if (h.kind != want) throw std::runtime_error(std::string("MsgPack: expected ") + name);
+        return h;
+    }
+    std::string_view payload(MsgPackKind want, const char* name) const {
+        MsgPackReader r = reader();
+        MsgPackHead h = r.head();
+        if (h.kind != want) throw std::runtime_error(std::string("MsgPack: expected ") + name);
+        return r.payload(h.n);
+    }
+};
+
+// Read-only view of a freeze() image. Lookups follow offsets and binary-search object keys in
+// place, so opening costs a header check and reading a field touches only the pages on its path.
+// Strings come back as views into the image (NUL-terminated). Offsets are bounds-checked against
+// the image size, but the image is otherwise trusted. It must stay mapped and unmodified while
+// views of it exist.
+//   Json::MappedFile file("reference.mjb");
+//   Json::FrozenView doc = file.root();
+//   double rate = doc["rates"]["EUR"].as_num();
+class Json::FrozenView {
+public:
+    explicit FrozenView(std::string_view image) : base_(image.data()), size_(image.size()) {
+        uint64_t head[4];
+        if (image.size() < frozen_header) throw std::runtime_error("Frozen: truncated image");
+        if (reinterpret_cast<uintptr_t>(base_) % 8 != 0) throw std::runtime_error("Frozen: image not 8-byte aligned");
+        std::memcpy(head, base_, sizeof(head));
+        if (head[0] != frozen_magic) throw std::runtime_error("Frozen: bad magic or byte order");
+        if (head[1] > image.size()) throw std::runtime_error("Frozen: truncated image");
+        size_ = static_cast<size_t>(head[1]);
+        slot_ = head[2];
+    }
+
+    bool is_null()   const { return kind() == FzNull; }
+    bool is_bool()   const { return kind() == FzBool; }
+    bool is_num()    const { return kind() == FzNum || kind() == FzInt || kind() == FzBigInt; }
+    bool is_str()    const { return kind() == FzStr; }
+    bool is_array()  const { return kind() == FzArray; }
+    bool is_object() const { return kind() == FzObject; }
+
+    bool as_bool() const {
+        if (!is_bool()) throw std::runtime_error("Frozen: expected bool");
+        return offset() != 0;
+    }
+    double as_num() const {
+        if (kind() == FzInt) return static_cast<double>(inline_int());
+        if (kind() == FzBigInt) {
+            double n = static_cast<double>(u64(offset() + 8));
+            return u64(offset()) ? -1.0 - n : n;
+        }
+        if (kind() != FzNum) throw std::runtime_error("Frozen: expected number");
+        double d;
+        std::memcpy(&d, bytes_at(offset(), 8), 8);
+        return d;
+    }
+    int64_t as_int() const {
+        if (kind() == FzInt) return inline_int();
+        if (kind() == FzBigInt) {
+            uint64_t n = u64(offset() + 8);
+            if (n > static_cast<uint64_t>(INT64_MAX)) throw std::runtime_error("Frozen: number out of int64 range");
+            return u64(offset()) ? -1 - static_cast<int64_t>(n) : static_cast<int64_t>(n);
+        }
+        return to_int64(as_num(), "Frozen");
+    }
+    std::string_view as_str() const {
+        if (kind() != FzStr) throw std::runtime_error("Frozen: expected string");
+        return str(offset());
+    }
+
+    // Element or member count.
+    size_t size() const {
+        if (!is_array() && !is_object()) throw std::runtime_error("Frozen: expected array or object");
+        return static_cast<size_t>(u64(offset()));
+    }
+    std::optional<FrozenView> find(std::string_view key) const {
+        if (!is_object()) throw std::runtime_error("Frozen: expected object");
+        uint64_t n = u64(offset());
+        const uint64_t keys = offset() + 8;
+        uint64_t lo = 0, hi = n;
+        while (lo < hi) {
+            uint64_t mid = lo + (hi - lo) / 2;
+            int c = str(u64(keys + 8 * mid)).compare(key);
+            if (c == 0) return FrozenView(*this, u64(keys + 8 * n + 8 * mid));
+            if (c < 0) lo = mid + 1; else hi = mid;
+        }
+        return std::nullopt;
+    }
+    FrozenView at(std::string_view key) const {
+        auto v = find(key);
+        if (!v) throw std::out_of_range("Frozen: key not found");
+        return *v;
+    }
+    FrozenView operator[](std::string_view key) const { return at(key); }
+
+    FrozenView at(size_t index) const {
+        if (!is_array()) throw std::runtime_error("Frozen: expected array");
+        if (index >= u64(offset())) throw std::out_of_range("Frozen: index out of range");
+        return FrozenView(*this, u64(offset() + 8 + 8 * index));
+    }
+    FrozenView operator[](size_t index) const { return at(index); }
+
+    // Array elements in order; f(const FrozenView&) returns false to stop early.
+    template <class F>
+    void for_each(F f) const {
+        size_t n = size();
+        for (size_t k = 0; k < n; ++k) if (!f(at(k))) return;
+    }
+    // Object members in key order; f(std::string_view key, const FrozenView&) returns false to stop.
+    template <class F>
+    void for_each_member(F f) const {
+        if (!is_object()) throw std::runtime_error("Frozen: expected object");
+        uint64_t n = u64(offset());
+        for (uint64_t k = 0; k < n; ++k) {
+            if (!f(str(u64(offset() + 8 + 8 * k)), FrozenView(*this, u64(offset() + 8 + 8 * n + 8 * k)))) return;
+        }
+    }
+
+    // Copies this value (and everything under it) into a regular Json.
+    Json get() const {
+        switch (kind()) {
+        case FzNull: return Json(nullptr);
+        case FzBool: return Json(as_bool());
+        case FzNum: return Json(as_num());
+        case FzBigInt: return exact_integer(u64(offset()) != 0, u64(offset() + 8));
+        case FzInt: {
+            int64_t v = inline_int();
+            return v < 0 ? exact_integer(true, ~static_cast<uint64_t>(v)) : exact_integer(false, static_cast<uint64_t>(v));
+        }
+        case FzStr: return Json(std::string(as_str()));
+        case FzArray: {
+            Array a;
+            a.reserve(size());
+            for_each([&](const FrozenView& v) { a.push_back(v.get()); return true; });
+            return Json(std::move(a));
+        }
+        default: {
+            Object o;
+            for_each_member([&](std::string_view k, const FrozenView& v) { o.emplace(std::string(k), v.get()); return true; });
+            return Json(std::move(o));
+        }
+        }
+    }
+    std::string dump(int indent = -1) const { return get().dump(indent); }
+
+private:
+    const char* base_;
+    size_t size_;
+    uint64_t slot_{ 0 };
+
+    FrozenView(const FrozenView& parent, uint64_t slot) : base_(parent.base_), size_(parent.size_), slot_(slot) {}
+
+    unsigned kind() const { return static_cast<unsigned>(slot_ & 7); }
+    uint64_t offset() const { return slot_ >> 3; }
+    int64_t inline_int() const { return static_cast<int64_t>(slot_) >> 3; }
+    const char* bytes_at(uint64_t off, uint64_t n) const {
+        if (off > size_ || size_ - off < n) throw std::runtime_error("Frozen: offset out of range");
+        return base_ + off;
+    }
+    uint64_t u64(uint64_t off) const {
+        uint64_t v;
+        std::memcpy(&v, bytes_at(off, 8), 8);
+        return v;
+    }
+    std::string_view str(uint64_t off) const {
+        uint64_t n = u64(off);
+        return std::string_view(bytes_at(off + 8, n), static_cast<size_t>(n));
+    }
+};
+
+#if MINIJSON_HAS_MMAP
+// Read-only mapping of a file, typically a freeze() image written to disk. Pages are loaded on
+// first touch, so opening a large image costs page faults for the parts read, not a parse.
+class Json::MappedFile {
+public:
+    explicit MappedFile(const char* path) : MappedFile(::open(path, O_RDONLY)) {}
+    // Maps a whole open descriptor (file or shm_open segment) and closes it.
+    explicit MappedFile(int fd) {
+        if (fd < 0) throw std::runtime_error("Frozen: cannot open file");
+        struct stat st;
+        if (::fstat(fd, &st) != 0) { ::close(fd); throw std::runtime_error("Frozen: cannot stat file"); }
+        size_ = static_cast<size_t>(st.st_size);
+        void* p = size_ ? ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0) : nullptr;
+        ::close(fd);
+        if (p == MAP_FAILED) throw std::runtime_error("Frozen: cannot map file");
+        data_ = static_cast<const char*>(p);
+    }
+    ~MappedFile() { if (data_) ::munmap(const_cast<char*>(data_), size_); }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& o) noexcept : data_(o.data_), size_(o.size_) { o.data_ = nullptr; }
+    MappedFile& operator=(MappedFile&& o) noexcept {
+        if (this != &o) {
+            if (data_) ::munmap(const_cast<char*>(data_), size_);
+            data_ = o.data_; size_ = o.size_; o.data_ = nullptr;
+        }
+        return *this;
+    }
+
+    std::string_view bytes() const { return std::string_view(data_, size_); }
+    FrozenView root() const { return FrozenView(bytes()); }
+
+private:
+    const char* data_{ nullptr };
+    size_t size_{ 0 };
+};
+
+// Read-only snapshot of a Json in POSIX shared memory, so N worker processes share one copy of
+// e.g. a routing table instead of each parsing their own. publish() freezes the document into a
+// new segment "<name>.<generation>" and then atomically bumps the generation in the small
+// control segment "<name>"; the previous generation's name is unlinked, and its memory goes away
+// once the last reader unmaps it. Readers call current() (one atomic load when nothing changed)
+// and keep the returned pointer alive while they use views of it. The image is offset-based,
+// so it reads the same at whatever address each process maps it. Names follow shm_open rules
+// (leading '/'); on glibc before 2.34 link with -lrt.
+//   // publisher                          // each worker
+//   Json::SharedSnapshot::publish("/routes", table);
+//                                          Json::SharedSnapshot routes("/routes");
+//                                          auto img = routes.current();
+//                                          auto backend = img->root()["hosts"][host].as_str();
+class Json::SharedSnapshot {
+public:
+    explicit SharedSnapshot(std::string name) : name_(std::move(name)) {}
+    ~SharedSnapshot() { if (ctl_) ::munmap(ctl_, sizeof(Control)); }
+    SharedSnapshot(const SharedSnapshot&) = delete;
+    SharedSnapshot& operator=(const SharedSnapshot&) = delete;
+
+    // Image of the newest generation, or nullptr if nothing has been published yet.
+    std::shared_ptr<const MappedFile> current() {
+        if (!ctl_ && !(ctl_ = map_control(name_, false))) return nullptr;
+        while (true) {
+            uint64_t gen = ctl_->generation.load(std::memory_order_acquire);
+            if (gen == gen_) return image_;
+            if (gen == 0) return nullptr;
+            int fd = ::shm_open(segment(name_, gen).c_str(), O_RDONLY, 0);
+            if (fd < 0) {
+                if (errno != ENOENT) throw std::runtime_error("Frozen: cannot open segment");
+                // replaced and unlinked between the load and the open: reload, unless it was remove()d
+                if (ctl_->generation.load(std::memory_order_acquire) == gen) return image_;
+                continue;
+            }
+            image_ = std::make_shared<const MappedFile>(fd);
+            gen_ = gen;
+            return image_;
+        }
+    }
+    uint64_t generation() const { return gen_; }
+
+    // Freezes doc into the next generation and makes it current; returns that generation.
+    static uint64_t publish(const std::string& name, const Json& doc, mode_t mode = 0600) {
+        Control* ctl = map_control(name, true, mode);
+        std::string img = doc.freeze();
+        uint64_t gen = ctl->generation.load(std::memory_order_acquire);
+        int fd;
+        // claim the next unused generation (O_EXCL), in case two publishers race
+        while ((fd = ::shm_open(segment(name, ++gen).c_str(), O_CREAT | O_EXCL | O_RDWR, mode)) < 0) {
+            if (errno != EEXIST) { ::munmap(ctl, sizeof(Control)); throw std::runtime_error("Frozen: cannot create segment"); }
+        }
+        void* p = ::ftruncate(fd, static_cast<off_t>(img.size())) == 0 ? ::mmap(nullptr, img.size(), PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+        ::close(fd);
+        if (p == MAP_FAILED) {
+            ::shm_unlink(segment(name, gen).c_str());
+            ::munmap(ctl, sizeof(Control));
+            throw std::runtime_error("Frozen: cannot map segment");
+        }
+        std::memcpy(p, img.data(), img.size());
+        ::munmap(p, img.size());
+        uint64_t old = ctl->generation.load(std::memory_order_relaxed);
+        while (old < gen && !ctl->generation.compare_exchange_weak(old, gen, std::memory_order_acq_rel)) {}
+        if (old < gen && old != 0) ::shm_unlink(segment(name, old).c_str());
+        else if (old > gen) ::shm_unlink(segment(name, gen).c_str()); // a newer one already won
+        ::munmap(ctl, sizeof(Control));
+        return gen;
+    }
+    // Unlinks the control segment and the current generation; mapped readers keep their images.
+    static void remove(const std::string& name) {
+        if (Control* ctl = map_control(name, false)) {
+            uint64_t gen = ctl->generation.load(std::memory_order_acquire);
+            if (gen) ::shm_unlink(segment(name, gen).c_str());
+            ::munmap(ctl, sizeof(Control));
+        }
+        ::shm_unlink(name.c_str());
+    }
+
+private:
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared generation counter needs lock-free 64-bit atomics");
+    // Zero-filled by ftruncate on creation, which is generation 0 (nothing published).
+    struct Control {
+        std::atomic<uint64_t> generation;
+    };
+
+    std::string name_;
+    Control* ctl_{ nullptr };
+    uint64_t gen_{ 0 };
+    std::shared_ptr<const MappedFile> image_;
+
+    static std::string segment(const std::string& name, uint64_t gen) { return name + "." + std::to_string(gen); }
+    static Control* map_control(const std::string& name, bool create, mode_t mode = 0600) {
+        int fd = ::shm_open(name.c_str(), create ? O_CREAT | O_RDWR : O_RDONLY, mode);
+        if (fd < 0) {
+            if (!create && errno == ENOENT) return nullptr;
+            throw std::runtime_error("Frozen: cannot open control segment");
+        }
+        struct stat st;
+        bool ok = ::fstat(fd, &st) == 0 && (st.st_size >= static_cast<off_t>(sizeof(Control)) || (create && ::ftruncate(fd, sizeof(Control)) == 0));
+        if (!ok && !create) { ::close(fd); return nullptr; } // publisher hasn't sized it yet
+        void* p = ok ? ::mmap(nullptr, sizeof(Control), create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+        ::close(fd);
+        if (p == MAP_FAILED) throw std::runtime_error("Frozen: cannot map control segment");
+        return static_cast<Control*>(p);
+    }
+};
+#endif
+
+// Resumable serializer: hands out dump(indent) a bounded piece at a time, keeping its place in
+// the tree between calls. It reads the document in place, which must outlive it and stay
+// unchanged until done(); pass an rvalue to hand the document over instead. Long strings are
+// escaped incrementally, so memory stays around chunk bytes whatever the document size. With a
+// non-blocking socket:
+//   auto v = s.peek(); ssize_t n = send(fd, v.data(), v.size(), 0); if (n > 0) s.consume(n);
+class Json::Serializer {
+public:
+    explicit Serializer(const Json& doc, int indent = -1, size_t chunk = 4096)
+        : indent_(indent), chunk_(chunk ? chunk : 1) {
+        start_value(doc);
+    }
+    explicit Serializer(Json&& doc, int indent = -1, size_t chunk = 4096)
+        : own_(std::move(doc)), indent_(indent), chunk_(chunk ? chunk : 1) {
+        start_value(own_);
+    }
+    Serializer(const Serializer&) = delete;
+    Serializer& operator=(const Serializer&) = delete;
+
+    // Next pending bytes (at least chunk unless the document ends first); empty once done.
+    std::string_view peek() {
+        if (pos_ == buf_.size()) { buf_.clear(); pos_ = 0; }
+        else if (pos_ >= chunk_) { buf_.erase(0, pos_); pos_ = 0; } // partial sends: keep buf_ bounded
+        while (buf_.size() - pos_ < chunk_ && step()) {}
+        return std::string_view(buf_).substr(pos_);
+    }
+    // Marks n bytes of the last peek() as sent.
+    void consume(size_t n) { pos_ += n < buf_.size() - pos_ ? n : buf_.size() - pos_; }
+    // Copies up to n bytes into dst; returns 0 once the whole document has been produced.
+    size_t read(char* dst, size_t n) {
+        size_t w = 0;
+        while (w < n) {
+            std::string_view v = peek();
+            if (v.empty()) break;
+            size_t k = v.size() < n - w ? v.size() : n - w;
+            std::memcpy(dst + w, v.data(), k);
+            consume(k);
+            w += k;
+        }
+        return w;
+    }
+    bool done() const { return finished() && pos_ == buf_.size(); }
+
+private:
+    struct Frame {
+        const Array* a;
+        const Object* o;
+        size_t i;
+        Object::const_iterator it;
+    };
+
+    Json own_; // the document, when handed over
+    int indent_;
+    size_t chunk_;
+    std::string buf_;
+    size_t pos_{ 0 };
+    std::vector<Frame> stack_;
+    std::string_view str_;   // string value being escaped (or raw text being copied), if any
+    size_t str_pos_{ 0 };
+    bool in_str_{ false };
+    bool str_raw_{ false };
+
+    bool finished() const { return stack_.empty() && !in_str_; }
+
+    void newline(size_t depth) {
+        if (indent_ < 0) return;
+        buf_ += '\n';
+        buf_.append(depth * static_cast<size_t>(indent_), ' ');
+    }
+    void start_value(const Json& v) {
+        if (v.is_array() || v.is_object()) {
+            Frame f{ nullptr, nullptr, 0, {} };
+            if (v.is_array()) f.a = &v.as_array(); else { f.o = &v.as_object(); f.it = f.o->begin(); }
+            buf_ += f.a ? '[' : '{';
+            stack_.push_back(f);
+        }
+        else if (v.is_str() || v.is_raw()) {
+            str_raw_ = v.is_raw();
+            if (!str_raw_) buf_ += '\"';
+            str_ = str_raw_ ? v.as_raw() : v.as_str(); str_pos_ = 0; in_str_ = true;
+        }
+        else v.dump_impl(buf_, indent_, static_cast<int>(stack_.size()));
+    }
+    // Appends the next piece of output; false when there is nothing left.
+    bool step() {
+        if (in_str_) {
+            size_t n = str_.size() - str_pos_ < 1024 ? str_.size() - str_pos_ : 1024;
+            if (str_raw_) buf_.append(str_.data() + str_pos_, n);
+            else escape_to(buf_, str_.substr(str_pos_, n));
+            str_pos_ += n;
+            if (str_pos_ == str_.size()) { if (!str_raw_) buf_ += '\"'; in_str_ = false; }
+            return true;
+        }
+        if (stack_.empty()) return false;
+        Frame& f = stack_.back();
+        bool more = f.a ? f.i < f.a->size() : f.it != f.o->end();
+        if (!more) {
+            bool empty = f.i == 0;
+            char close = f.a ? ']' : '}';
+            stack_.pop_back();
+            if (!empty) newline(stack_.size());
+            buf_ += close;
+            return true;
+        }
+        if (f.i++ > 0) buf_ += ',';
+        newline(stack_.size());
+        if (f.a) { start_value((*f.a)[f.i - 1]); return true; }
+        const auto& kv = *f.it++;
+        buf_ += '\"'; escape_to(buf_, kv.first); buf_ += "\":";
+        if (indent_ >= 0) buf_ += ' ';
+        start_value(kv.second); // may push onto stack_, invalidating f
+        return true;
+    }
+};
+
+// Reads the elements of one array, at the top level or at a JSON Pointer, from a stream that
+// may be far larger than memory: each next() parses one element into its own Json. Only the
+// current element and the read buffer are held, and the buffer grows only to fit an element
+// larger than it. ParseOptions apply to each element on its own (pointers are relative to it).
+// Values passed over on the way to the array are skipped without being held, checking only
+// their nesting. A top-level array must be followed by nothing but whitespace; with a pointer,
+// reading stops at the array's closing bracket. After an exception the stream can't be resumed.
+//   std::ifstream in("export.json", std::ios::binary);
+//   Json::ArrayStream rows(in, "/records");
+//   for (Json row; rows.next(row);) handle(row);
+class Json::ArrayStream {
+public:
+    // read(dst, n) fills up to n bytes and returns how many; 0 means end of input.
+    explicit ArrayStream(std::function<size_t(char*, size_t)> read, std::string_view pointer = "",
+                         const ParseOptions& opt = ParseOptions(), size_t chunk = 65536)
+        : in_(std::move(read), chunk), pointer_(pointer), opt_(opt) {}
+    explicit ArrayStream(std::istream& in, std::string_view pointer = "",
+                         const ParseOptions& opt = ParseOptions(), size_t chunk = 65536)
+        : ArrayStream(StreamBuffer::reader(in), pointer, opt, chunk) {}
+    ArrayStream(const ArrayStream&) = delete;
+    ArrayStream& operator=(const ArrayStream&) = delete;
+
+    // Parses the next element into out; false (leaving out alone) once the array has ended.
+    bool next(Json& out) {
+        if (state_ == Done) return false;
+        if (state_ == Start) { open(); state_ = First; }
+        if (!in_.skip_ws()) throw std::runtime_error("JSON: unterminated container");
+        char c = in_.buf[in_.pos];
+        if (c == ']') { finish(); return false; }
+        if (state_ == More) {
+            if (c != ',') throw std::runtime_error("JSON: expected ',' or ']'");
+            ++in_.pos;
+            if (!in_.skip_ws()) throw std::runtime_error("JSON: unexpected end of input");
+        }
+        in_.frame(true);
+        offset_ = in_.base + in_.mark;
+        out = in_.parse(&opt_);
+        ++count_;
+        state_ = More;
+        return true;
+    }
+    // Elements returned so far.
+    size_t count() const { return count_; }
+    // Byte offset in the stream of the element last returned.
+    uint64_t offset() const { return offset_; }
+    // Current read buffer size: the chunk size, or more after an element that didn't fit.
+    size_t buffer_size() const { return in_.buf.size() - PaddedString::padding; }
+
+private:
+    enum State { Start, First, More, Done };
+
+    StreamBuffer in_;
+    std::string pointer_;
+    ParseOptions opt_;
+    State state_{ Start };
+    size_t count_{ 0 };
+    uint64_t offset_{ 0 };
+
+    // Walks pointer_ down to the array and steps past its '['.
+    void open() {
+        std::string_view ptr = pointer_;
+        std::string tok;
+        while (next_token(ptr, tok)) {
+            if (!in_.skip_ws()) throw std::runtime_error("JSON: unexpected end of input");
+            char c = in_.buf[in_.pos++];
+            if (c == '{') seek_member(tok);
+            else if (c == '[') seek_index(tok);
+            else throw std::runtime_error("JSON: bad pointer");
+        }
+        if (!in_.skip_ws()) throw std::runtime_error("JSON: unexpected end of input");
+        if (in_.buf[in_.pos] != '[') throw std::runtime_error("JSON: expected '['");
+        ++in_.pos;
+    }
+    // Inside an object: skips members up to the value of key.
+    void seek_member(const std::string& key) {
+        in_.skip_ws();
+        if (in_.peek() == '}') throw std::runtime_error("JSON: bad pointer");
+        while (true) {
+            in_.skip_ws();
+            if (in_.peek() != '"') throw std::runtime_error("JSON: expected string key");
+            in_.frame(true);
+            bool match = in_.parse(nullptr).as_str() == key;
+            in_.skip_ws();
+            in_.expect(':');
+            in_.skip_ws();
+            if (match) return;
+            in_.frame(false);
+            in_.skip_ws();
+            char c = in_.peek();
+            ++in_.pos;
+            if (c == '}') throw std::runtime_error("JSON: bad pointer");
+            if (c != ',') throw std::runtime_error("JSON: expected ',' or '}'");
+        }
+    }
+    // Inside an array: skips elements up to index tok.
+    void seek_index(const std::string& tok) {
+        size_t idx;
+        if (!parse_index(tok, idx)) throw std::runtime_error("JSON: bad pointer");
+        for (size_t k = 0;; ++k) {
+            in_.skip_ws();
+            if (in_.peek() == ']') throw std::runtime_error("JSON: bad pointer");
+            if (k == idx) return;
+            in_.frame(false);
+            in_.skip_ws();
+            char c = in_.peek();
+            ++in_.pos;
+            if (c == ']') throw std::runtime_error("JSON: bad pointer");
+            if (c != ',') throw std::runtime_error("JSON: expected ',' or ']'");
+        }
+    }
+    void finish() {
+        ++in_.pos;
+        state_ = Done;
+        if (pointer_.empty() && in_.skip_ws()) throw std::runtime_error("JSON: trailing characters");
+    }
+};
+
+// Reads a run of JSON documents from one buffer or stream: back to back ({...}{...}), separated
+// by whitespace or newlines (NDJSON), or as an RFC 7464 JSON text sequence, where each document
+// follows an RS byte (0x1E). The read buffer and the padded parse are shared by every document.
+// A bad document makes next() throw, but the stream stays usable: offset() tells where that
+// document began (to log it or retry the bytes from there) and the next call resumes after it.
+// In a text sequence an RS cuts a truncated document short and the next one still parses.
+//   Json::DocumentStream docs(body);
+//   for (Json d; docs.next(d);) handle(d, docs.offset());
+class Json::DocumentStream {
+public:
+    // read(dst, n) fills up to n bytes and returns how many; 0 means end of input.
+    explicit DocumentStream(std::function<size_t(char*, size_t)> read, const ParseOptions& opt = ParseOptions(), size_t chunk = 65536)
+        : in_(std::move(read), chunk), opt_(opt) {}
+    explicit DocumentStream(std::istream& in, const ParseOptions& opt = ParseOptions(), size_t chunk = 65536)
+        : DocumentStream(StreamBuffer::reader(in), opt, chunk) {}
+    // The text must outlive the stream; it is read in chunks like any other source.
+    explicit DocumentStream(std::string_view text, const ParseOptions& opt = ParseOptions(), size_t chunk = 65536)
+        : DocumentStream(StreamBuffer::reader(text), opt, chunk) {}
+    DocumentStream(const DocumentStream&) = delete;
+    DocumentStream& operator=(const DocumentStream&) = delete;
+
+    // Parses the next document into out; false (leaving out alone) at end of input.
+    bool next(Json& out) {
+        while (true) {
+            if (!in_.skip_ws()) return false;
+            if (in_.buf[in_.pos] != '\x1E') break;
+            in_.records = true;
+            ++in_.pos;
+        }
+        offset_ = in_.base + in_.pos;
+        try {
+            in_.frame(true);
+        }
+        catch (...) {
+            if (in_.base + in_.pos == offset_) ++in_.pos; // a stray byte: step over it
+            throw;
+        }
+        out = in_.parse(&opt_);
+        ++count_;
+        return true;
+    }
+    // Documents returned so far.
+    size_t count() const { return count_; }
+    // Byte offset in the stream where the document last returned (or rejected) starts.
+    uint64_t offset() const { return offset_; }
+
+private:
+    StreamBuffer in_;
+    ParseOptions opt_;
+    size_t count_{ 0 };
+    uint64_t offset_{ 0 };
+};
+
+// Scatter-gather output for writev/WSASend: punctuation, numbers and escaped text go into a small
+// side buffer, while raw fragments and strings of at least min_ref bytes that need no escaping
+// are referenced in place. The segments point into the dumped Json, which must stay alive and
+// unmodified until the data is sent. Reuse one Gather across dumps: clear() keeps its capacity.
+// writev accepts at most IOV_MAX (typically 1024) entries per call, so send large outputs in batches.
+class Json::Gather {
+public:
+    explicit Gather(size_t min_ref = 256) : min_ref_(min_ref) {}
+
+    void clear() { side_.clear(); segs_.clear(); }
+    size_t size() const {
+        size_t n = 0;
+        for (const auto& s : segs_) n += s.len;
+        return n;
+    }
+    size_t segments() const { return segs_.size(); }
+    // Calls f(const char* data, size_t len) for each segment in order.
+    template <class F>
+    void for_each(F f) const {
+        for (const auto& s : segs_) f(s.ext ? s.ext : side_.data() + s.off, s.len);
+    }
+#if MINIJSON_HAS_IOVEC
+    void to_iovec(std::vector<iovec>& out) const {
+        out.clear();
+        out.reserve(segs_.size());
+        for_each([&](const char* p, size_t n) { out.push_back(iovec{ const_cast<char*>(p), n }); });
+    }
+#endif
+
+    // Sink interface used by dump_impl.
+    void push_back(char c) { side_.push_back(c); grow_side(1); }
+    void append(const char* p, size_t n) { side_.append(p, n); grow_side(n); }
+    void append(size_t n, char c) { side_.append(n, c); grow_side(n); }
+    void string_body(std::string_view s) {
+        if (s.size() < min_ref_ || escaped_size(s) != s.size()) { escape_to(*this, s); return; }
+        segs_.push_back({ s.data(), 0, s.size() });
+    }
+    void raw(std::string_view s) {
+        if (s.size() < min_ref_) append(s.data(), s.size());
+        else segs_.push_back({ s.data(), 0, s.size() });
+    }
+
+private:
+    // ext == nullptr: bytes [off, off + len) of side_ (offsets survive side_ reallocating).
+    struct Seg { const char* ext; size_t off; size_t len; };
+
+    size_t min_ref_;
+    std::string side_;
+    std::vector<Seg> segs_;
+
+    void grow_side(size_t n) {
+        if (!segs_.empty() && !segs_.back().ext) segs_.back().len += n;
+        else segs_.push_back({ nullptr, side_.size() - n, n });
+    }
+};
+
+// Streaming writer: emits JSON straight into a sink as it is produced, without building a tree.
+// Sink is std::string or anything with push_back(char), append(const char*, size_t) and
+// append(size_t, char). Output is byte-identical to Json::dump(indent) for the same structure.
+// Misuse (key outside an object, unbalanced end_*, two top-level values) is asserted in debug builds only.
+template <class Sink>
+class JsonWriter {
+public:
+    explicit JsonWriter(Sink& out, int indent = -1) : out_(out), indent_(indent) {}
+
+    JsonWriter& begin_object() { open('{', true); return *this; }
+    JsonWriter& end_object() { close('}', true); return *this; }
+    JsonWriter& begin_array() { open('[', false); return *this; }
+    JsonWriter& end_array() { close(']', false); return *this; }
+
+    JsonWriter& key(std::string_view k) {
+        assert(!stack_.empty() && stack_.back().object && !after_key_ && "JsonWriter: key outside object");
+        separate();
+        out_.push_back('\"'); Json::escape_to(out_, k); out_.append("\":", 2);
+        if (indent_ >= 0) out_.push_back(' ');
+        after_key_ = true;
+        return *this;
+    }
+
+    JsonWriter& value(std::nullptr_t) { before_value(); out_.append("null", 4); return *this; }
+    JsonWriter& value(bool b) {
+        before_value();
+        if (b) out_.append("true", 4); else out_.append("false", 5);
+        return *this;
+    }
+    JsonWriter& value(double d) {
+        before_value();
+        char buf[32];
+        out_.append(buf, Json::format_num(d, buf));
+        return *this;
+    }
+    // Any integer type (counts, ids, int64_t...): written as exact digits, so values past 2^53
+    // don't go through double the way Json(int) does.
+    template <class T, std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool>, int> = 0>
+    JsonWriter& value(T i) {
+        before_value();
+        char buf[24];
+        out_.append(buf, static_cast<size_t>(std::to_chars(buf, buf + sizeof(buf), i).ptr - buf));
+        return *this;
+    }
+    JsonWriter& value(std::string_view s) {
+        before_value();
+        out_.push_back('\"'); Json::escape_to(out_, s); out_.push_back('\"');
+        return *this;
+    }
+    JsonWriter& value(const char* s) { return value(std::string_view(s)); }
+    JsonWriter& value(const std::string& s) { return value(std::string_view(s)); }
+    // Copies pre-serialized JSON text through verbatim.
+    JsonWriter& raw(std::string_view json) {
+        before_value();
+        out_.append(json.data(), json.size());
+        return *this;
+    }
+    // Splices an existing tree in at the current position.
+    JsonWriter& value(const Json& j) {
+        before_value();
+        j.dump_impl(out_, indent_, static_cast<int>(stack_.size()));
+        return *this;
+    }
+
+    // True once exactly one top-level value has been written and every container closed.
+    bool complete() const { return stack_.empty() && wrote_root_; }
+
+private:
+    struct Frame { bool object; size_t count; };
+
+    Sink& out_;
+    int indent_;
+    std::vector<Frame> stack_;
+    bool after_key_{ false };
+    bool wrote_root_{ false };
+
+    void newline(size_t depth) {
+        if (indent_ < 0) return;
+        out_.push_back('\n');
+        out_.append(depth * static_cast<size_t>(indent_), ' ');
+    }
+    void separate() {
+        if (stack_.back().count++ > 0) out_.push_back(',');
+        newline(stack_.size());
+    }
+    void before_value() {
+        if (stack_.empty()) {
+            assert(!wrote_root_ && "JsonWriter: more than one top-level value");
+            wrote_root_ = true;
+            return;
+        }
+        if (stack_.back().object) {
+            assert(after_key_ && "JsonWriter: value without key");
+            after_key_ = false;
+        }
+        else separate();
+    }
+    void open(char c, bool object) {
+        before_value();
+        out_.push_back(c);
+        stack_.push_back({ object, 0 });
+    }
+    void close(char c, bool object) {
+        assert(!stack_.empty() && stack_.back().object == object && !after_key_ && "JsonWriter: mismatched end");
+        (void)object;
+        size_t n = stack_.back().count;
+        stack_.pop_back();
+        if (n) newline(stack_.size());
+        out_.push_back(c);
+    }
 };